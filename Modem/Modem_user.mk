@@ -14,6 +14,8 @@ Modem_USER_CSRC = \
     $(Modem_HW_PATH)/afsk.c \
     $(Modem_HW_PATH)/protocol/SimpleSerial.c \
     $(Modem_HW_PATH)/protocol/KISS.c \
+    bertos/algo/rs.c \
+    bertos/net/fx25.c \
 	#
 
 # Files included by the user.
@@ -11,6 +11,10 @@
 #include <cpu/power.h>      // Power management from BertOS
 #include <cpu/pgm.h>        // Access to PROGMEM from BertOS
 #include <struct/fifobuf.h> // FIFO buffer implementation from BertOS
+#include <struct/pool.h>    // Pool of frame buffers from BertOS
+#include <algo/crc_ccitt.h> // CRC-CCITT from BertOS, for checking frames
+#include <net/ax25.h>       // For the AX.25 frame constants
+#include <net/fx25.h>       // FX.25 correlation tags and decoding
 #include <string.h>         // String operations, primarily used for memset function
 
 
@@ -64,6 +68,38 @@ INLINE uint8_t sinSample(uint16_t i) {
     return (i >= (SIN_LEN/2)) ? (255 - sine) : sine;
 }
 
+#if CONFIG_AFSK_G3RUH
+// Pulse shapes for G3RUH. Each bit is sent as a raised
+// cosine pulse, which reaches into the bits on either
+// side of it and keeps the signal within what the
+// radio can pass. A sample in the middle of a bit then
+// only depends on that bit and its two neighbours, so
+// instead of filtering, we look up the four samples of
+// each bit by the previous, current and next bit.
+static const uint8_t PROGMEM g3ruh_shape[8][G3RUH_SAMPLESPERBIT] =
+{
+    {   8,   7,   7,   8 },     // 000
+    {   4,   1,  22,  85 },     // 001
+    { 174, 240, 240, 174 },     // 010
+    { 171, 234, 255, 252 },     // 011
+    {  85,  22,   1,   4 },     // 100
+    {  82,  16,  16,  82 },     // 101
+    { 252, 255, 234, 171 },     // 110
+    { 248, 249, 249, 248 },     // 111
+};
+
+// The scrambler and descrambler both work on the last
+// 17 bits sent, with the polynomial x^17 + x^12 + 1.
+// This keeps long runs of the same level off the air,
+// which a radio built for audio can't pass, whatever
+// the data is.
+#define G3RUH_TAPS(lfsr) ((((lfsr) >> 16) ^ ((lfsr) >> 11)) & 1)
+
+// The baseband samples are scaled up to use about as
+// much of the filter as the discriminator products do
+#define G3RUH_INPUT_SHIFT 4
+#endif
+
 // A very basic macro that just checks whether the last bit
 // of a whatever is passed into it differ. This is used in the
 // next macro.
@@ -95,6 +131,64 @@ INLINE uint8_t sinSample(uint16_t i) {
 #define PHASE_MAX    (SAMPLESPERBIT * PHASE_BITS)   // Resolution of our phase counter = 64
 #define PHASE_THRESHOLD  (PHASE_MAX / 2)           	// Target transition point of our phase window
 
+// Carrier detect constants. Once the phase is in sync
+// with a real signal, its transitions all come close
+// to where we expect them, while noise makes them just
+// anywhere. Each transition inside the window counts
+// up, each one outside counts down more, and the
+// channel is busy while the count is high enough.
+#define DCD_WINDOW   (PHASE_BITS * 3 / 2)           // How far off a transition may be, a sample and a half
+#define DCD_GOOD     1                              // Count up this much for a transition in the window
+#define DCD_BAD      2                              // And down this much for one outside it
+#define DCD_MAX      32                             // Highest the count goes
+#define DCD_ON       16                             // Count where we call it a signal
+
+#if CONFIG_AFSK_PLL
+// Clock recovery loop constants. The loop keeps the
+// phase counter with some extra fraction bits, so it
+// can make corrections smaller than a phase step, and
+// learns how much the transmitter's bit clock is off
+// from ours, in fractions of a step per bit.
+#define PLL_FRAC          8                         // Fraction bits kept below the phase counter
+#define PLL_ACQ_SHIFT     1                         // Correct half the error on each transition while acquiring
+#define PLL_TRACK_SHIFT   2                         // But only a quarter of it once locked
+#define PLL_FREQ_SHIFT    8                         // And learn the clock offset this much slower
+#define PLL_FREQ_MAX      ((PHASE_MAX << PLL_FRAC) / 25) // Follow clock offsets of up to 4%
+
+// The loop is locked when most transitions come
+// about where it expects them. This is the same
+// window carrier detect uses, but it is checked on
+// the finer phase of the loop, and it takes fewer
+// good transitions, so the loop can settle down
+// well before the end of the preamble.
+#define PLL_LOCK_WINDOW   (DCD_WINDOW << PLL_FRAC)  // How far off a transition may be while locked
+#define PLL_LOCK_GOOD     1                         // Count up this much for a transition in the window
+#define PLL_LOCK_BAD      2                         // And down this much for one outside it
+#define PLL_LOCK_MAX      16                        // Highest the count goes
+#define PLL_LOCK_ON       4                         // Count where we call the loop locked
+#define PLL_LOCKED(demod) ((demod)->pllLock >= PLL_LOCK_ON)
+#endif
+
+#if CONFIG_AFSK_AGC
+// Input levelling constants. The offset follows a
+// slow average of the ADC readings, and the gain is
+// turned down quickly when the peaks get too loud,
+// and up more slowly when they get too quiet. The
+// peaks only fall slowly between tones, so the gain
+// stays put over the length of a packet.
+#define AGC_OFFSET_FRAC   5                         // Fraction bits of the offset, 10 + 5 fit in 16
+#define AGC_OFFSET_SHIFT  7                         // Follow the average over about 128 samples
+#define AGC_SCALE_SHIFT   (AGC_OFFSET_FRAC + 2 + 8) // From 1/32 steps of 10 bits to 8 bits, and the gain
+#define AGC_GAIN_ONE      256                       // Gain that does what the fixed shift did
+#define AGC_GAIN_MIN      (AGC_GAIN_ONE / 2)        // Least gain, for audio that fills the ADC
+#define AGC_GAIN_MAX      (AGC_GAIN_ONE * 32)       // Most gain, for the quietest audio
+#define AGC_HIGH          (96 << 8)                 // Turn the gain down when the peaks are above this
+#define AGC_LOW           (48 << 8)                 // And up when they are below this
+#define AGC_ATTACK        4                         // Turning down takes out 1/16 per sample
+#define AGC_RELEASE       7                         // Turning up adds 1/128 per sample
+#define AGC_PEAK_DECAY    9                         // Peaks fall by 1/512 per sample
+#endif
+
 // Modulation constants
 #define MARK_FREQ  1200        // The tone frequency signifying a binary one
 #define SPACE_FREQ 2200        // The tone frequency signifying a binary zero
@@ -104,6 +198,21 @@ INLINE uint8_t sinSample(uint16_t i) {
 #define MARK_INC   (uint16_t)(DIV_ROUND(SIN_LEN * (uint32_t)MARK_FREQ, CONFIG_AFSK_DAC_SAMPLERATE))
 #define SPACE_INC  (uint16_t)(DIV_ROUND(SIN_LEN * (uint32_t)SPACE_FREQ, CONFIG_AFSK_DAC_SAMPLERATE))
 
+#if CONFIG_AFSK_PROFILES
+// The same for the 300 baud HF profile, which uses
+// tones only 200Hz apart, to fit in an SSB channel.
+// The constants above are those of the 1200 baud one.
+#define HF_BITRATE    300
+#define HF_MARK_FREQ  1600
+#define HF_SPACE_FREQ 1800
+#define HF_MARK_INC   (uint16_t)(DIV_ROUND(SIN_LEN * (uint32_t)HF_MARK_FREQ, CONFIG_AFSK_DAC_SAMPLERATE))
+#define HF_SPACE_INC  (uint16_t)(DIV_ROUND(SIN_LEN * (uint32_t)HF_SPACE_FREQ, CONFIG_AFSK_DAC_SAMPLERATE))
+#define HF_SAMPLESPERBIT (SAMPLERATE / HF_BITRATE)
+
+STATIC_ASSERT(HF_SAMPLESPERBIT <= SAMPLESPERBIT_MAX);
+STATIC_ASSERT(!(CONFIG_AFSK_DAC_SAMPLERATE % HF_BITRATE));
+#endif
+
 // HDLC flag bytes
 #define HDLC_FLAG  0x7E     // An HDLC_FLAG is used to signify the start or end of a frame
 #define HDLC_RESET 0x7F     // An HDLC_RESET is used to abruptly stop or reset a transmission
@@ -111,6 +220,50 @@ INLINE uint8_t sinSample(uint16_t i) {
                             // the actual data. This is similar to escaping an " character in a
                             // string enclosed by "s.
 
+// The delay line must be able to hold the discriminator delay
+STATIC_ASSERT(SAMPLESPERBIT / 2 < DEMOD_DELAY_LEN);
+
+#if CONFIG_AFSK_CORRELATOR
+// Correlator constants. Both tones are made from one
+// cosine table, stepping through it at different
+// speeds. With 48 entries, one step is 200Hz at our
+// sample rate, and both tones are a whole number of
+// steps, so the table lines up with the samples
+// exactly and there is nothing to drift.
+#define CORR_LEN        48                                      // Entries in the cosine table
+#define CORR_QUARTER    (CORR_LEN / 4)                          // A quarter wave, to get the sine
+#define CORR_MARK_STEP  (MARK_FREQ * CORR_LEN / SAMPLERATE)     // Steps per sample for mark (6)
+#define CORR_SPACE_STEP (SPACE_FREQ * CORR_LEN / SAMPLERATE)    // Steps per sample for space (11)
+
+// Where a tone was in the table a bit ago, when the
+// oldest sample the sums hold came in, relative to now
+#define CORR_BACK(step, samples) ((CORR_LEN - ((step) * (samples)) % CORR_LEN) % CORR_LEN)
+
+// Tone twist correction. The gain for space is in
+// 1/256ths, and is kept between a quarter and four
+// times, which is about 12dB either way.
+#define CORR_GAIN_ONE   256
+#define CORR_GAIN_MIN   (CORR_GAIN_ONE / 4)
+#define CORR_GAIN_MAX   (CORR_GAIN_ONE * 4)
+#define CORR_GAIN_STEP  2                                       // How much to change it per bit
+#define CORR_LEVEL_SHIFT 4                                      // Smoothing of the tone levels
+
+STATIC_ASSERT(CORR_MARK_STEP * SAMPLERATE == MARK_FREQ * CORR_LEN);
+STATIC_ASSERT(CORR_SPACE_STEP * SAMPLERATE == SPACE_FREQ * CORR_LEN);
+
+#if CONFIG_AFSK_PROFILES
+#define CORR_HF_MARK_STEP  (HF_MARK_FREQ * CORR_LEN / SAMPLERATE)   // Steps per sample at 1600Hz (8)
+#define CORR_HF_SPACE_STEP (HF_SPACE_FREQ * CORR_LEN / SAMPLERATE)  // And at 1800Hz (9)
+
+STATIC_ASSERT(CORR_HF_MARK_STEP * SAMPLERATE == HF_MARK_FREQ * CORR_LEN);
+STATIC_ASSERT(CORR_HF_SPACE_STEP * SAMPLERATE == HF_SPACE_FREQ * CORR_LEN);
+#endif
+
+// The correlator sums over exactly one bit, so
+// the delay line must hold at least that much
+STATIC_ASSERT(DEMOD_DELAY_LEN >= SAMPLESPERBIT);
+#endif
+
 // Check that sample rate is divisible by bitrate.
 // If this is not the case, all of our algorithms will
 // fail horribly and we will cry.
@@ -120,10 +273,25 @@ STATIC_ASSERT(!(CONFIG_AFSK_DAC_SAMPLERATE % BITRATE));
 // on the physical medium.
 #define DAC_SAMPLESPERBIT (CONFIG_AFSK_DAC_SAMPLERATE / BITRATE)
 
+// Channel access and keying up are done in the
+// modulation part further down, but the ADC ISR
+// and the encoder need them first
+static void afsk_csma(Afsk *afsk, int8_t currentSample);
+static void afsk_txKey(Afsk *afsk);
+
 //////////////////////////////////////////////////////
 // Link Layer Control and Demodulation              //
 //////////////////////////////////////////////////////
 
+// Notes down that we had to drop received data,
+// because there was no room to put it
+INLINE void rxOverrun(Afsk *afsk) {
+    afsk->status |= RX_OVERRUN;
+    #if CONFIG_AFSK_TELEMETRY
+    if (afsk->stats.overruns < UINT16_MAX) afsk->stats.overruns++;
+    #endif
+}
+
 // hdlcParse /////////////////////////////////////////
 // This function looks at the raw bits demodulated from
 // the physical medium and tries to parse actual data
@@ -132,17 +300,40 @@ STATIC_ASSERT(!(CONFIG_AFSK_DAC_SAMPLERATE % BITRATE));
 // starts or ends, or where the payload is. We only try
 // to detect that a transmission is taking place, then
 // synchronise to the start and end of the transmitted
-// bytes, and push these up to the data-link layer, in
-// this example the MP.x protocol. It is then the
-// protocols job to actually recreate the full packet.
-// Also note that the data is not "pushed" per se, but
-// stored in a FIFO buffer, that the protocol must
-// continously read to recreate the received packets.
-static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
-    // Initialise a return value. We start with the
-    // assumption that all is going to end well :)
-    bool ret = true;
+// bytes, and tell the caller what we found: a flag, an
+// abort, or a complete byte. What happens to those is
+// then up to the caller, which normally just pushes
+// them to a FIFO buffer that the protocol continously
+// reads to recreate the received packets.
+
+// Things hdlcParse can find. Anything from 0 to 255 is
+// a received data byte.
+#define HDLC_NOTHING    -1  // Nothing complete yet
+#define HDLC_GOT_FLAG   -2  // We found an HDLC_FLAG
+#define HDLC_GOT_RESET  -3  // We found an HDLC_RESET, or silence
+
+#if CONFIG_AFSK_TELEMETRY
+// Counts the bytes of the frame being received, and
+// whether it ends with a flag or an abort. Anything
+// too short to be a frame is just noise, and isn't
+// counted either way.
+INLINE void hdlcCountByte(Hdlc *hdlc) {
+    if (hdlc->bytes < 255) hdlc->bytes++;
+}
 
+INLINE void hdlcCountEnd(Hdlc *hdlc, bool aborted) {
+    if (hdlc->bytes >= AX25_MIN_FRAME_LEN) {
+        uint16_t *counter = aborted ? &hdlc->aborts : &hdlc->frames;
+        if (*counter < UINT16_MAX) (*counter)++;
+    }
+    hdlc->bytes = 0;
+}
+#else
+#define hdlcCountByte(hdlc)         do { } while (0)
+#define hdlcCountEnd(hdlc, aborted) do { } while (0)
+#endif
+
+static int16_t hdlcParse(Hdlc *hdlc, bool bit) {
     // Bitshift our byte of demodulated bits to
     // the left by one bit, to make room for the
     // next incoming bit
@@ -154,24 +345,9 @@ static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
     // Now we'll look at the last 8 received bits, and
     // check if we have received a HDLC flag (01111110)
     if (hdlc->demodulatedBits == HDLC_FLAG) {
-        // If we have, check that our output buffer is
-        // not full.
-        if (!fifo_isfull(fifo)) {
-            // If it isn't, we'll push the HDLC_FLAG into
-            // the buffer and indicate that we are now
-            // receiving data. For bling we also turn
-            // on the RX LED.
-            fifo_push(fifo, HDLC_FLAG);
-            hdlc->receiving = true;
-            LED_RX_ON();
-        } else {
-            // If the buffer is full, we have a problem
-            // and abort by setting the return value to
-            // false and stopping the here.
-            ret = false;
-            hdlc->receiving = false;
-            LED_RX_OFF();
-        }
+        // If we have, we indicate that we are now
+        // receiving data.
+        hdlc->receiving = true;
 
         // Everytime we receive a HDLC_FLAG, we reset the
         // storage for our current incoming byte and bit
@@ -180,7 +356,8 @@ static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
         // of the received bytes.
         hdlc->currentByte = 0;
         hdlc->bitIndex = 0;
-        return ret;
+        hdlcCountEnd(hdlc, false);
+        return HDLC_GOT_FLAG;
     }
 
     // Check if we have received a RESET flag (01111111)
@@ -194,15 +371,15 @@ static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
         // If we have, something probably went wrong at the
         // transmitting end, and we abort the reception.
         hdlc->receiving = false;
-        LED_RX_OFF();
-        return ret;
+        hdlcCountEnd(hdlc, true);
+        return HDLC_GOT_RESET;
     }
 
     // If we have not yet seen a HDLC_FLAG indicating that
     // a transmission is actually taking place, don't bother
     // with anything.
     if (!hdlc->receiving)
-        return ret;
+        return HDLC_NOTHING;
 
     // First check if what we are seeing is a stuffed bit.
     // Since the different HDLC control characters like
@@ -221,7 +398,7 @@ static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
     // if the result of the operation is 00111110 (0x3e), we
     // have detected a stuffed bit.
     if ((hdlc->demodulatedBits & 0x3f) == 0x3e)
-        return ret;
+        return HDLC_NOTHING;
 
     // If we have an actual 1 bit, push this to the current byte
     // If it's a zero, we don't need to do anything, since the
@@ -231,87 +408,1164 @@ static bool hdlcParse(Hdlc *hdlc, bool bit, FIFOBuffer *fifo) {
 
     // Increment the bitIndex and check if we have a complete byte
     if (++hdlc->bitIndex >= 8) {
-        // If we have a HDLC control character, put a AX.25 escape
-        // in the received data. We know we need to do this,
-        // because at this point we must have already seen a HDLC
-        // flag, meaning that this control character is the result
-        // of a bitstuffed byte that is equal to said control
-        // character, but is actually part of the data stream.
-        // By inserting the escape character, we tell the protocol
-        // layer that this is not an actual control character, but
-        // data.
-        if ((hdlc->currentByte == HDLC_FLAG ||
-             hdlc->currentByte == HDLC_RESET ||
-             hdlc->currentByte == AX25_ESC)) {
-            // We also need to check that our received data buffer
-            // is not full before putting more data in
-            if (!fifo_isfull(fifo)) {
-                fifo_push(fifo, AX25_ESC);
-            } else {
-                // If it is, abort and return false
-                hdlc->receiving = false;
-                LED_RX_OFF();
-                ret = false;
-            }
+        // If we do, hand it over, and wipe the received
+        // byte and reset bit index to 0
+        uint8_t byte = hdlc->currentByte;
+        hdlc->currentByte = 0;
+        hdlc->bitIndex = 0;
+        hdlcCountByte(hdlc);
+        return byte;
+    } else {
+        // We don't have a full byte yet, bitshift the byte
+        // to make room for the next bit
+        hdlc->currentByte >>= 1;
+    }
+
+    return HDLC_NOTHING;
+}
+
+#if CONFIG_AFSK_RX_FRAMES
+
+// When receiving whole frames, the frame buffers are
+// kept in a pool. A buffer is taken from the pool by
+// a demodulator when it starts on a frame, is put in
+// the ready list of the modem when the frame is
+// complete, and goes back to the pool once the
+// protocol has dealt with it. The frame is never
+// copied on the way.
+DECLARE_POOL_STATIC(rxPool, AfskFrame, CONFIG_AFSK_RX_FRAMES);
+
+// Every demodulator holds on to a buffer while it's
+// receiving, so we need at least one more than that.
+STATIC_ASSERT(CONFIG_AFSK_RX_FRAMES > CONFIG_AFSK_DEMODULATORS);
+
+// rxFrameClear //////////////////////////////////////
+// Empties a frame buffer, to receive a new frame
+// into it.
+INLINE void rxFrameClear(AfskFrame *frame) {
+    frame->len = 0;
+    #if CONFIG_AFSK_SOFT_BITS
+    frame->weakCount = 0;
+    #endif
+}
+
+// rxFrameStart //////////////////////////////////////
+// Gets a free frame buffer to receive a frame into.
+// Returns NULL if the protocol hasn't handed any of
+// them back yet. We don't take anything back from
+// the ready list in that case, so the frames already
+// received are never lost. It's the frames that are
+// still to come that will have to wait.
+static AfskFrame *rxFrameStart(Afsk *afsk) {
+    AfskFrame *frame = (AfskFrame *)pool_alloc(&rxPool);
+    if (frame) {
+        rxFrameClear(frame);
+    } else {
+        rxOverrun(afsk);
+        afsk->rxDropped++;
+    }
+    return frame;
+}
+
+// rxFrameEnd ////////////////////////////////////////
+// Puts a complete frame in line for the protocol.
+INLINE void rxFrameEnd(Afsk *afsk, AfskFrame *frame) {
+    #if CONFIG_AFSK_SOFT_BITS
+    // The flag that ended the frame got on the weak
+    // list too, before we knew it was a flag, so we
+    // take off anything past the end of the frame.
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < frame->weakCount; i++) {
+        if (frame->weak[i] < frame->len * 8) {
+            frame->weak[n] = frame->weak[i];
+            frame->weakConf[n] = frame->weakConf[i];
+            n++;
         }
+    }
+    frame->weakCount = n;
+    #endif
+    ADDTAIL(&afsk->rxReady, &frame->link);
+}
 
-        // Push the actual byte to the received data FIFO,
-        // if it isn't full.
-        if (!fifo_isfull(fifo)) {
-            fifo_push(fifo, hdlc->currentByte);
+#if CONFIG_AFSK_SOFT_BITS
+// rxFrameNoteBit ////////////////////////////////////
+// Called with each bit before it goes to the HDLC
+// parser, with how sure the demodulator is of it.
+// If it is one of the least sure bits of the frame
+// so far, it goes on the weak list, which is kept
+// sorted with the least sure bit first.
+static void rxFrameNoteBit(Demod *demod, bool bit, uint8_t conf) {
+    AfskFrame *frame = demod->rxFrame;
+    Hdlc *hdlc = &demod->hdlc;
+    if (!frame || !hdlc->receiving) return;
+
+    // A stuffed bit isn't part of the frame, see
+    // hdlcParse
+    if ((((hdlc->demodulatedBits << 1) | bit) & 0x3f) == 0x3e) return;
+
+    // If the list is full, the new bit has to be
+    // less sure than the last one to get on it
+    uint8_t n = frame->weakCount;
+    if (n == CONFIG_AFSK_SOFT_BITS) {
+        if (conf >= frame->weakConf[n - 1]) return;
+        n--;
+    } else {
+        frame->weakCount++;
+    }
+
+    // Make room for it in the right place
+    while (n > 0 && frame->weakConf[n - 1] > conf) {
+        frame->weak[n] = frame->weak[n - 1];
+        frame->weakConf[n] = frame->weakConf[n - 1];
+        n--;
+    }
+    frame->weak[n] = frame->len * 8 + hdlc->bitIndex;
+    frame->weakConf[n] = conf;
+}
+#endif
+
+#endif
+
+#if CONFIG_AFSK_PROFILES
+
+// Settings for each demodulator, like those of a bank
+// of them below, but for each profile. Instead of a
+// shift, the feedback of the filter is a fraction,
+// so it can be made to smooth over longer bits.
+typedef struct DemodParams
+{
+    uint8_t delay;
+    uint8_t filterGain;
+    int8_t phaseInc;
+    int16_t threshold;
+} DemodParams;
+
+// At 1200 baud, these are the same settings as
+// without profiles, with y/2 and y/4 as 128/256
+// and 64/256, which round exactly the same way.
+static const DemodParams demodParams1200[] =
+{
+    { 4, 128, 1,    0 },
+    { 4, 128, 1, -128 },
+    { 4, 128, 1,  128 },
+    { 4,  64, 1,  -64 },
+    { 4, 128, 2,    0 },
+    { 4, 128, 1, -256 },
+    { 5, 128, 1,    0 },
+    { 4,  64, 2,   64 },
+};
+
+// At 300 baud, the discriminator looks back 24
+// samples, over which mark goes round exactly four
+// times and space four and a half, so they come out
+// as far apart as they can. With four times as many
+// samples in a bit, the filter smooths a lot more.
+static const DemodParams demodParams300[] =
+{
+    { 24, 224, 1,    0 },
+    { 24, 224, 1, -128 },
+    { 24, 224, 1,  128 },
+    { 24, 192, 1,    0 },
+    { 24, 224, 2,    0 },
+    { 24, 240, 1,    0 },
+    { 24, 224, 1, -256 },
+    { 24, 192, 2,  128 },
+};
+STATIC_ASSERT(CONFIG_AFSK_DEMODULATORS <= countof(demodParams1200));
+STATIC_ASSERT(CONFIG_AFSK_DEMODULATORS <= countof(demodParams300));
+
+#if CONFIG_AFSK_G3RUH
+// At 9600 baud there is no discriminator, the audio
+// level is the bit itself. With only four samples in
+// a bit, the filter has to be quick.
+static const DemodParams demodParams9600[] =
+{
+    { 0,  64, 1,    0 },
+    { 0,  64, 1, -128 },
+    { 0,  64, 1,  128 },
+    { 0,   0, 1,    0 },
+    { 0,  64, 2,    0 },
+    { 0, 128, 1,    0 },
+    { 0,  64, 1, -256 },
+    { 0,  64, 1,  256 },
+};
+STATIC_ASSERT(CONFIG_AFSK_DEMODULATORS <= countof(demodParams9600));
+#endif
+
+// Everything else that differs between the profiles,
+// worked out beforehand so switching is only a matter
+// of pointing the modem at another one of these.
+typedef struct AfskProfile
+{
+    uint16_t bitrate;                       // Bits per second
+    uint8_t samplesPerBit;                  // ADC samples per bit
+    uint8_t phaseBits;                      // Phase steps per sample, PHASE_MAX per bit
+    uint8_t productShift;                   // Scaling of the discriminator products
+    uint8_t dacSamplesPerBit;               // DAC samples per bit
+    uint16_t markInc;                       // Sine table steps per sample for mark
+    uint16_t spaceInc;                      // And for space
+    #if CONFIG_AFSK_CORRELATOR
+    uint8_t corrMarkStep;                   // Cosine table steps per sample for mark
+    uint8_t corrSpaceStep;                  // And for space
+    uint8_t corrMarkBack;                   // Where mark was a bit ago, see CORR_BACK
+    uint8_t corrSpaceBack;                  // And space
+    #endif
+    #if CONFIG_AFSK_G3RUH
+    uint16_t sampleRate;                    // How often the ADC interrupt runs
+    bool baseband;                          // Scrambled baseband instead of tones
+    #endif
+    const DemodParams *demods;              // Settings of the demodulators
+} AfskProfile;
+
+// The phase counter always goes round once a bit, so
+// the clock recovery and carrier detect constants
+// work the same in both profiles, as fractions of a
+// bit. The 300 baud filters have up to eight times
+// the gain, so their input is scaled down that much
+// more.
+static const AfskProfile afskProfiles[AFSK_PROFILES] =
+{
+    [AFSK_PROFILE_1200] = {
+        BITRATE, SAMPLESPERBIT, PHASE_BITS, 2,
+        DAC_SAMPLESPERBIT, MARK_INC, SPACE_INC,
+        #if CONFIG_AFSK_CORRELATOR
+        CORR_MARK_STEP, CORR_SPACE_STEP,
+        CORR_BACK(CORR_MARK_STEP, SAMPLESPERBIT), CORR_BACK(CORR_SPACE_STEP, SAMPLESPERBIT),
+        #endif
+        #if CONFIG_AFSK_G3RUH
+        SAMPLERATE, false,
+        #endif
+        demodParams1200,
+    },
+    [AFSK_PROFILE_300] = {
+        HF_BITRATE, HF_SAMPLESPERBIT, PHASE_MAX / HF_SAMPLESPERBIT, 5,
+        CONFIG_AFSK_DAC_SAMPLERATE / HF_BITRATE, HF_MARK_INC, HF_SPACE_INC,
+        #if CONFIG_AFSK_CORRELATOR
+        CORR_HF_MARK_STEP, CORR_HF_SPACE_STEP,
+        CORR_BACK(CORR_HF_MARK_STEP, HF_SAMPLESPERBIT), CORR_BACK(CORR_HF_SPACE_STEP, HF_SAMPLESPERBIT),
+        #endif
+        #if CONFIG_AFSK_G3RUH
+        SAMPLERATE, false,
+        #endif
+        demodParams300,
+    },
+    #if CONFIG_AFSK_G3RUH
+    // There are no tones at 9600 baud, so the
+    // increments only tell the two levels apart
+    [AFSK_PROFILE_9600] = {
+        G3RUH_BITRATE, G3RUH_SAMPLESPERBIT, PHASE_MAX / G3RUH_SAMPLESPERBIT, 0,
+        G3RUH_SAMPLESPERBIT, 1, 0,
+        G3RUH_SAMPLERATE, true,
+        demodParams9600,
+    },
+    #endif
+};
+STATIC_ASSERT(PHASE_MAX % HF_SAMPLESPERBIT == 0);
+
+#define PROFILE_BITRATE(afsk)           ((afsk)->profile->bitrate)
+#define PROFILE_SAMPLESPERBIT(afsk)     ((afsk)->profile->samplesPerBit)
+#define PROFILE_PHASE_BITS(afsk)        ((afsk)->profile->phaseBits)
+#define PROFILE_PRODUCT_SHIFT(afsk)     ((afsk)->profile->productShift)
+#define PROFILE_DAC_SAMPLESPERBIT(afsk) ((afsk)->profile->dacSamplesPerBit)
+#define PROFILE_MARK_INC(afsk)          ((afsk)->profile->markInc)
+#define PROFILE_SPACE_INC(afsk)         ((afsk)->profile->spaceInc)
+#if CONFIG_AFSK_G3RUH
+#define PROFILE_SAMPLERATE(afsk)        ((afsk)->profile->sampleRate)
+#define PROFILE_BASEBAND(afsk)          ((afsk)->profile->baseband)
+#else
+#define PROFILE_SAMPLERATE(afsk)        SAMPLERATE
+#endif
+#if CONFIG_AFSK_CORRELATOR
+#define PROFILE_CORR_MARK_STEP(afsk)    ((afsk)->profile->corrMarkStep)
+#define PROFILE_CORR_SPACE_STEP(afsk)   ((afsk)->profile->corrSpaceStep)
+#define PROFILE_CORR_MARK_BACK(afsk)    ((afsk)->profile->corrMarkBack)
+#define PROFILE_CORR_SPACE_BACK(afsk)   ((afsk)->profile->corrSpaceBack)
+#endif
+
+// Each demodulator uses the settings its
+// profile has for it
+#define DEMOD_DELAY(demod)          ((demod)->delay)
+#define DEMOD_FEEDBACK(demod, y)    ((int16_t)(((int32_t)(y) * (demod)->filterGain) >> 8))
+#define DEMOD_PHASE_INC(demod)      ((demod)->phaseInc)
+#define DEMOD_THRESHOLD(demod)      ((demod)->threshold)
+
+#else
+
+// Without profiles, everything is fixed at 1200 baud
+#define PROFILE_BITRATE(afsk)           BITRATE
+#define PROFILE_SAMPLESPERBIT(afsk)     SAMPLESPERBIT
+#define PROFILE_PHASE_BITS(afsk)        PHASE_BITS
+#define PROFILE_PRODUCT_SHIFT(afsk)     2
+#define PROFILE_DAC_SAMPLESPERBIT(afsk) DAC_SAMPLESPERBIT
+#define PROFILE_MARK_INC(afsk)          MARK_INC
+#define PROFILE_SPACE_INC(afsk)         SPACE_INC
+#define PROFILE_SAMPLERATE(afsk)        SAMPLERATE
+#if CONFIG_AFSK_CORRELATOR
+#define PROFILE_CORR_MARK_STEP(afsk)    CORR_MARK_STEP
+#define PROFILE_CORR_SPACE_STEP(afsk)   CORR_SPACE_STEP
+#define PROFILE_CORR_MARK_BACK(afsk)    CORR_BACK(CORR_MARK_STEP, SAMPLESPERBIT)
+#define PROFILE_CORR_SPACE_BACK(afsk)   CORR_BACK(CORR_SPACE_STEP, SAMPLESPERBIT)
+#endif
+
+#endif
+
+#if CONFIG_AFSK_DEMODULATORS == 1
+
+#if !CONFIG_AFSK_PROFILES
+// With a single demodulator, its settings are simply
+// constants, so the compiler can optimise for them.
+#define DEMOD_DELAY(demod)          (SAMPLESPERBIT / 2)
+#define DEMOD_FEEDBACK(demod, y)    ((y) >> 1)
+#define DEMOD_PHASE_INC(demod)      PHASE_INC
+#define DEMOD_THRESHOLD(demod)      0
+#endif
+
+#if !CONFIG_AFSK_RX_FRAMES
+
+// hdlcAbortFifo /////////////////////////////////////
+// If some of a frame is in the received data FIFO
+// already, pushes an HDLC_RESET after it, so the
+// protocol throws it away instead of checking it at
+// the next flag. Returns false if the FIFO is full.
+static bool hdlcAbortFifo(Hdlc *hdlc, FIFOBuffer *fifo) {
+    if (!hdlc->fifoFrame) return true;
+    if (fifo_isfull(fifo)) return false;
+    fifo_push(fifo, HDLC_RESET);
+    hdlc->fifoFrame = false;
+    hdlc->fifoCut = false;
+    return true;
+}
+
+// hdlcToFifo ////////////////////////////////////////
+// Takes what hdlcParse found and pushes it to the
+// received data FIFO for the protocol to read.
+// Returns false if the FIFO overflowed.
+static bool hdlcToFifo(Hdlc *hdlc, int16_t found, FIFOBuffer *fifo) {
+    // Initialise a return value. We start with the
+    // assumption that all is going to end well :)
+    bool ret = true;
+
+    if (found == HDLC_NOTHING) {
+        return ret;
+    } else if (found == HDLC_GOT_FLAG) {
+        // If the last frame was cut short by a full
+        // FIFO, the flag must not end it, so it is
+        // aborted first. Then we check that our output
+        // buffer is not full.
+        if (hdlc->fifoCut) hdlcAbortFifo(hdlc, fifo);
+        if (!hdlc->fifoCut && !fifo_isfull(fifo)) {
+            // If it isn't, we'll push the HDLC_FLAG into
+            // the buffer. For bling we also turn on the
+            // RX LED.
+            fifo_push(fifo, HDLC_FLAG);
+            hdlc->fifoFrame = false;
+            LED_RX_ON();
         } else {
-            // If it is, well, you know by now!
+            // If the buffer is full, we have a problem
+            // and abort by setting the return value to
+            // false and stopping the here. Without its
+            // flag, the frame in the FIFO is cut too.
+            ret = false;
             hdlc->receiving = false;
+            hdlc->fifoCut = hdlc->fifoFrame;
             LED_RX_OFF();
+        }
+        return ret;
+    } else if (found == HDLC_GOT_RESET) {
+        // The frame we were receiving, if any, is
+        // aborted, and the protocol must know
+        if (!hdlcAbortFifo(hdlc, fifo)) {
+            hdlc->fifoCut = true;
             ret = false;
         }
+        LED_RX_OFF();
+        return ret;
+    }
 
-        // Wipe received byte and reset bit index to 0
-        hdlc->currentByte = 0;
-        hdlc->bitIndex = 0;
+    // We have a byte. If we have a HDLC control character,
+    // put a AX.25 escape in the received data. We know we
+    // need to do this, because at this point we must have
+    // already seen a HDLC flag, meaning that this control
+    // character is the result of a bitstuffed byte that is
+    // equal to said control character, but is actually part
+    // of the data stream. By inserting the escape character,
+    // we tell the protocol layer that this is not an actual
+    // control character, but data.
+    if ((found == HDLC_FLAG ||
+         found == HDLC_RESET ||
+         found == AX25_ESC)) {
+        // We also need to check that our received data buffer
+        // is not full before putting more data in
+        if (!fifo_isfull(fifo)) {
+            fifo_push(fifo, AX25_ESC);
+            hdlc->fifoFrame = true;
+        } else {
+            // If it is, abort and return false. What
+            // we have pushed of the frame is aborted
+            // at the next flag.
+            hdlc->receiving = false;
+            hdlc->fifoCut = hdlc->fifoFrame;
+            LED_RX_OFF();
+            ret = false;
+        }
+    }
 
+    // Push the actual byte to the received data FIFO,
+    // if it isn't full.
+    if (!fifo_isfull(fifo)) {
+        fifo_push(fifo, found);
+        hdlc->fifoFrame = true;
     } else {
-        // We don't have a full byte yet, bitshift the byte
-        // to make room for the next bit
-        hdlc->currentByte >>= 1;
+        // If it is, well, you know by now!
+        hdlc->receiving = false;
+        hdlc->fifoCut = hdlc->fifoFrame;
+        LED_RX_OFF();
+        ret = false;
     }
 
     return ret;
 }
 
-// adcISR ////////////////////////////////////////////
-// This is the Interrupt Service Routine for the
-// Analog to Digital Conversion. It is called 9600
-// times each second to analyze the sample taken from
-// the physical medium. The job of this routine is
-// to detect whether we have a "mark" or "space"
-// frequency present on the baseband (the physical
-// medium). The result of this analysis will then
-// be passed to the HDLC parser in form of a 1 or a 0
-void afsk_adc_isr(Afsk *afsk, int8_t currentSample) {
+#endif
+
+#else
+
+#if !CONFIG_AFSK_PROFILES
+// Settings for each demodulator in the bank. The
+// first one is the classic single demodulator, and
+// the others differ in how far back the discriminator
+// looks, how smooth the filter is, how hard the clock
+// recovery pulls, and where mark and space are split,
+// which helps on audio with a lot of tone twist.
+typedef struct DemodParams
+{
+    uint8_t delay;
+    uint8_t filterShift;
+    int8_t phaseInc;
+    int16_t threshold;
+} DemodParams;
+
+static const DemodParams demodParams[] =
+{
+    { 4, 1, 1,    0 },
+    { 4, 1, 1, -128 },
+    { 4, 1, 1,  128 },
+    { 4, 2, 1,  -64 },
+    { 4, 1, 2,    0 },
+    { 4, 1, 1, -256 },
+    { 5, 1, 1,    0 },
+    { 4, 2, 2,   64 },
+};
+STATIC_ASSERT(CONFIG_AFSK_DEMODULATORS <= countof(demodParams));
+
+// Each demodulator uses its own settings
+#define DEMOD_DELAY(demod)          ((demod)->delay)
+#define DEMOD_FEEDBACK(demod, y)    ((y) >> (demod)->filterShift)
+#define DEMOD_PHASE_INC(demod)      ((demod)->phaseInc)
+#define DEMOD_THRESHOLD(demod)      ((demod)->threshold)
+#endif
+
+#if !CONFIG_AFSK_RX_FRAMES
+// Figures out how many bytes are free in a FIFO
+INLINE size_t fifoFree(FIFOBuffer *fifo) {
+    ptrdiff_t used = fifo->tail - fifo->head;
+    if (used < 0) used += fifo_len(fifo) + 1;
+    return fifo_len(fifo) - used;
+}
+#endif
+
+// Two copies of the same frame from different
+// demodulators will end within a few bits of each
+// other. Identical frames further apart than this
+// are real repeats, and are passed on as such.
+#define DEDUP_WINDOW(afsk) (PROFILE_SAMPLESPERBIT(afsk) * 32)
+
+// Once a frame has passed the CRC check, the CRC we
+// calculated is always the same magic number, so to
+// tell frames apart we look at the FCS they carry,
+// which is the last two bytes of the frame.
+INLINE uint16_t frameFcs(const uint8_t *buf, size_t len) {
+    return buf[len - 2] | (buf[len - 1] << 8);
+}
+
+// demodIsDuplicate //////////////////////////////////
+// Checks if another demodulator has passed on the
+// frame with this FCS within the window around the
+// given time. Must be called with the demodulators
+// locked.
+static bool demodIsDuplicate(Afsk *afsk, uint16_t time, uint16_t fcs, int16_t window) {
+    for (uint8_t i = 0; i < DEMOD_DEDUP_LEN; i++) {
+        DemodSeen *seen = &afsk->seen[i];
+        int16_t age = (int16_t)(time - seen->time);
+        if (seen->fcs == fcs && age < window && age > -window) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// demodRemember /////////////////////////////////////
+// Remembers that we passed on the frame that was
+// received at the given time, so we can spot copies.
+static void demodRemember(Afsk *afsk, uint16_t time, uint16_t fcs) {
+    afsk->seen[afsk->seenIndex].fcs = fcs;
+    afsk->seen[afsk->seenIndex].time = time;
+    afsk->seenIndex = (afsk->seenIndex + 1) % DEMOD_DEDUP_LEN;
+}
+
+#if !CONFIG_AFSK_RX_FRAMES
+
+// demodFrameDone ////////////////////////////////////
+// Called when one of the demodulators has received a
+// complete frame with a correct CRC. If no other
+// demodulator has just passed on the same frame, we
+// put it in the received data FIFO, escaped and
+// surrounded by flags just like hdlcToFifo would.
+static void demodFrameDone(Afsk *afsk, Demod *demod) {
+    AFSK_DEMOD_LOCK();
+
+    uint16_t fcs = frameFcs(demod->frame, demod->frameLen);
+    if (demodIsDuplicate(afsk, demod->time, fcs, DEDUP_WINDOW(afsk))) {
+        AFSK_DEMOD_UNLOCK();
+        return;
+    }
+
+    // We'll only put the frame in the FIFO if all
+    // of it fits, so count the escapes first.
+    size_t needed = demod->frameLen + 2;
+    for (size_t i = 0; i < demod->frameLen; i++) {
+        uint8_t c = demod->frame[i];
+        if (c == HDLC_FLAG || c == HDLC_RESET || c == AX25_ESC) needed++;
+    }
+
+    if (fifoFree(&afsk->rxFifo) < needed) {
+        rxOverrun(afsk);
+        AFSK_DEMOD_UNLOCK();
+        return;
+    }
+
+    fifo_push(&afsk->rxFifo, HDLC_FLAG);
+    for (size_t i = 0; i < demod->frameLen; i++) {
+        uint8_t c = demod->frame[i];
+        if (c == HDLC_FLAG || c == HDLC_RESET || c == AX25_ESC) fifo_push(&afsk->rxFifo, AX25_ESC);
+        fifo_push(&afsk->rxFifo, c);
+    }
+    fifo_push(&afsk->rxFifo, HDLC_FLAG);
+
+    demodRemember(afsk, demod->time, fcs);
+
+    AFSK_DEMOD_UNLOCK();
+}
+
+// hdlcToFrame ///////////////////////////////////////
+// Takes what hdlcParse found and collects it into
+// whole frames, checking the CRC as we go.
+static void hdlcToFrame(Afsk *afsk, Demod *demod, int16_t found) {
+    if (found == HDLC_NOTHING) {
+        return;
+    } else if (found == HDLC_GOT_FLAG) {
+        if (demod->frameLen >= AX25_MIN_FRAME_LEN && demod->crc == AX25_CRC_CORRECT) {
+            demodFrameDone(afsk, demod);
+        }
+        demod->frameLen = 0;
+        demod->crc = CRC_CCITT_INIT_VAL;
+        LED_RX_ON();
+    } else if (found == HDLC_GOT_RESET) {
+        demod->frameLen = 0;
+        LED_RX_OFF();
+    } else if (demod->hdlc.receiving) {
+        if (demod->frameLen < CONFIG_AX25_FRAME_BUF_LEN) {
+            demod->frame[demod->frameLen++] = found;
+            demod->crc = updcrc_ccitt(found, demod->crc);
+        } else {
+            // Too long to be a real frame, wait
+            // for the next flag.
+            demod->hdlc.receiving = false;
+            demod->frameLen = 0;
+        }
+    }
+}
+
+#endif
+
+#endif
+
+#if CONFIG_AFSK_RX_FRAMES
+
+// hdlcToPool ////////////////////////////////////////
+// Takes what hdlcParse found and puts it straight in
+// a frame buffer. A flag ends the frame we were
+// receiving, if it's long enough to be a real one,
+// and starts the next. An abort throws away what we
+// have received so far.
+//
+// With several demodulators, each of them receives
+// into a buffer of its own. When one has a frame
+// with a correct CRC that no other demodulator has
+// just passed on, the buffer itself is passed on.
+static void hdlcToPool(Afsk *afsk, Demod *demod, int16_t found) {
+    AfskFrame *frame = demod->rxFrame;
+
+    if (found == HDLC_NOTHING) {
+        return;
+    } else if (found == HDLC_GOT_FLAG) {
+        AFSK_DEMOD_LOCK();
+        if (frame && frame->len >= AX25_MIN_FRAME_LEN) {
+            #if CONFIG_AFSK_DEMODULATORS > 1
+            uint16_t fcs = frameFcs(frame->buf, frame->len);
+            if (demod->crc == AX25_CRC_CORRECT && !demodIsDuplicate(afsk, demod->time, fcs, DEDUP_WINDOW(afsk))) {
+                demodRemember(afsk, demod->time, fcs);
+                rxFrameEnd(afsk, frame);
+                frame = NULL;
+            }
+            #else
+            rxFrameEnd(afsk, frame);
+            frame = NULL;
+            #endif
+        }
+        if (frame) {
+            rxFrameClear(frame);
+        } else {
+            frame = rxFrameStart(afsk);
+        }
+        AFSK_DEMOD_UNLOCK();
+
+        demod->rxFrame = frame;
+        #if CONFIG_AFSK_DEMODULATORS > 1
+        demod->crc = CRC_CCITT_INIT_VAL;
+        #endif
+        LED_RX_ON();
+    } else if (found == HDLC_GOT_RESET) {
+        if (frame) rxFrameClear(frame);
+        LED_RX_OFF();
+    } else if (demod->hdlc.receiving && frame) {
+        if (frame->len < CONFIG_AX25_FRAME_BUF_LEN) {
+            frame->buf[frame->len++] = found;
+            #if CONFIG_AFSK_DEMODULATORS > 1
+            demod->crc = updcrc_ccitt(found, demod->crc);
+            #endif
+        } else {
+            // Too long to be a real frame, wait
+            // for the next flag.
+            demod->hdlc.receiving = false;
+            rxFrameClear(frame);
+        }
+    }
+}
+
+#endif
+
+// hdlcFound /////////////////////////////////////////
+// Hands whatever hdlcParse found on to the right
+// place for the demodulator setup we are built with.
+INLINE void hdlcFound(Afsk *afsk, Demod *demod, int16_t found) {
+    #if CONFIG_AFSK_RX_FRAMES
+    // The demodulators receive straight into
+    // the frame buffers.
+    hdlcToPool(afsk, demod, found);
+    #elif CONFIG_AFSK_DEMODULATORS > 1
+    // With several demodulators, we collect whole
+    // frames and let demodFrameDone sort them out.
+    hdlcToFrame(afsk, demod, found);
+    #else
+    // Otherwise the data goes straight to the FIFO.
+    // We also check the return of the Link Control
+    // parser to check if an error occured.
+    if (!hdlcToFifo(&demod->hdlc, found, &afsk->rxFifo)) {
+        rxOverrun(afsk);
+    }
+    #endif
+}
+
+#if CONFIG_AX25_FX25
+
+// FX.25 reception ///////////////////////////////////
+// An FX.25 transmission starts with a 64 bit
+// correlation tag, which says which Reed-Solomon
+// code follows. The block after the tag is sent
+// without bit stuffing, so the HDLC parser can't
+// make sense of it, and we just collect the bits as
+// they come. Correcting the block takes far too long
+// for the ISR, so the main loop does that when it
+// calls afsk_fx25Poll.
+//
+// Only the first demodulator looks for tags, since
+// one copy of the block is all the main loop has
+// time for anyway. The others still receive the
+// frame inside the block the normal way.
+#define FX25_IDLE       0   // Looking for a tag
+#define FX25_RECEIVING  1   // Collecting the block
+#define FX25_READY      2   // Waiting for the main loop
+
+// fx25Bit ///////////////////////////////////////////
+// Looks at each bit the first demodulator receives.
+// Returns true if the bit is part of a block, and so
+// should not go to the HDLC parser.
+INLINE bool fx25Bit(Afsk *afsk, Demod *demod, bool bit) {
+    if (afsk->fx25State == FX25_RECEIVING) {
+        // Bits are sent least significant bit first
+        uint16_t index = afsk->fx25Bits >> 3;
+        afsk->fx25Buf[index] >>= 1;
+        if (bit) afsk->fx25Buf[index] |= 0x80;
+
+        if (++afsk->fx25Bits == (uint16_t)fx25_blockLen(afsk->fx25Mode) * 8) {
+            #if CONFIG_AFSK_DEMODULATORS > 1
+            afsk->fx25Time = demod->time;
+            #endif
+            afsk->fx25Corr = 0;
+            afsk->fx25State = FX25_READY;
+        }
+        return true;
+    }
+
+    // Keep looking for a tag, unless the main loop
+    // hasn't gotten around to the last block yet.
+    afsk->fx25Corr = (afsk->fx25Corr >> 1) | ((uint64_t)bit << 63);
+    if (afsk->fx25State == FX25_IDLE) {
+        int8_t mode = fx25_tagFind(afsk->fx25Corr);
+        if (mode >= 0) {
+            afsk->fx25Mode = mode;
+            afsk->fx25Bits = 0;
+            afsk->fx25State = FX25_RECEIVING;
+
+            // Whatever the HDLC parser made of the
+            // tag is garbage, so we throw it away.
+            demod->hdlc.receiving = false;
+            hdlcFound(afsk, demod, HDLC_GOT_RESET);
+        }
+    }
+    return false;
+}
+
+// afsk_fx25Poll /////////////////////////////////////
+// Corrects the block the first demodulator has
+// collected, if there is one, and hands the frame in
+// it to the protocol. The CRC check in ax25_receive
+// has the last word, since a block with too many
+// errors for the code may still hold a good frame.
+void afsk_fx25Poll(Afsk *afsk, struct AX25Ctx *ax25) {
+    if (afsk->fx25State != FX25_READY) return;
+
+    int corrected;
+    size_t len = fx25_decode(afsk->fx25Buf, afsk->fx25Mode, &corrected);
+
+    if (len >= AX25_MIN_FRAME_LEN && crc_ccitt(CRC_CCITT_INIT_VAL, afsk->fx25Buf, len) == AX25_CRC_CORRECT) {
+        bool duplicate = false;
+
+        #if CONFIG_AFSK_DEMODULATORS > 1
+        // The other demodulators may well have
+        // received the frame inside the block too,
+        // any time since the block started.
+        uint16_t fcs = frameFcs(afsk->fx25Buf, len);
+        // At 300 baud, that can be longer than the
+        // sample counter goes before it wraps around.
+        uint32_t blockSamples = (uint32_t)(FX25_TAG_LEN + fx25_blockLen(afsk->fx25Mode)) * 8 * PROFILE_SAMPLESPERBIT(afsk);
+        int16_t window = MIN(blockSamples, (uint32_t)INT16_MAX);
+        AFSK_DEMOD_LOCK();
+        ATOMIC(
+            duplicate = demodIsDuplicate(afsk, afsk->fx25Time, fcs, window);
+            if (!duplicate) demodRemember(afsk, afsk->fx25Time, fcs);
+        );
+        AFSK_DEMOD_UNLOCK();
+        #endif
+
+        if (!duplicate) {
+            ax25_receive(ax25, afsk->fx25Buf, len);
+        }
+        afsk->fx25Frames++;
+        if (corrected > 0) afsk->fx25Fixed += corrected;
+    }
+
+    afsk->fx25State = FX25_IDLE;
+}
+
+#endif
+
+#if CONFIG_AFSK_HDLC_TABLE
+
+// hdlcParseByte /////////////////////////////////////
+// Instead of running hdlcParse for every bit, we can
+// collect eight bits and deal with them all at once.
+// Most of the time, eight received bits are just
+// eight bits of data: there is no flag, abort or
+// stuffed bit among them. To find out quickly if that
+// is the case, we look the byte up in a table that
+// tells us how many ones it starts and ends with, and
+// whether it has a run of five or more ones somewhere
+// in the middle. Together with the ones the previous
+// byte ended with, that is all we need to know. The
+// table also holds the byte with its bits reversed,
+// since HDLC sends the least significant bit first,
+// while we collect them with the first one on top.
+//
+// Anything else, which is flags, aborts and stuffed
+// bits, is rare enough that we just run it through
+// hdlcParse a bit at a time like we always did, so
+// the two ways of parsing always agree.
+//
+// Each table entry is laid out like this:
+//   bits 0-7:   The byte, in the order HDLC sends it
+//   bits 8-10:  Leading ones (up to 5)
+//   bits 11-13: Trailing ones (up to 7)
+//   bit 14:     Has a run of 5 ones ending in a zero
+//               after the leading ones, or ends in 7
+#define HDLC_TABLE_DATA(e)      ((uint8_t)(e))
+#define HDLC_TABLE_LEAD(e)      (((e) >> 8) & 0x07)
+#define HDLC_TABLE_TRAIL(e)     (((e) >> 11) & 0x07)
+#define HDLC_TABLE_SPECIAL      BV(14)
+
+// Anything with five ones in a row followed by a
+// zero needs hdlcParse to look at it
+#define HDLC_TABLE_MAX_ONES 5
+
+static const uint16_t PROGMEM hdlc_table[] =
+{
+    0x0000, 0x0880, 0x0040, 0x10C0, 0x0020, 0x08A0, 0x0060, 0x18E0,
+    0x0010, 0x0890, 0x0050, 0x10D0, 0x0030, 0x08B0, 0x0070, 0x20F0,
+    0x0008, 0x0888, 0x0048, 0x10C8, 0x0028, 0x08A8, 0x0068, 0x18E8,
+    0x0018, 0x0898, 0x0058, 0x10D8, 0x0038, 0x08B8, 0x0078, 0x28F8,
+    0x0004, 0x0884, 0x0044, 0x10C4, 0x0024, 0x08A4, 0x0064, 0x18E4,
+    0x0014, 0x0894, 0x0054, 0x10D4, 0x0034, 0x08B4, 0x0074, 0x20F4,
+    0x000C, 0x088C, 0x004C, 0x10CC, 0x002C, 0x08AC, 0x006C, 0x18EC,
+    0x001C, 0x089C, 0x005C, 0x10DC, 0x003C, 0x08BC, 0x407C, 0x30FC,
+    0x0002, 0x0882, 0x0042, 0x10C2, 0x0022, 0x08A2, 0x0062, 0x18E2,
+    0x0012, 0x0892, 0x0052, 0x10D2, 0x0032, 0x08B2, 0x0072, 0x20F2,
+    0x000A, 0x088A, 0x004A, 0x10CA, 0x002A, 0x08AA, 0x006A, 0x18EA,
+    0x001A, 0x089A, 0x005A, 0x10DA, 0x003A, 0x08BA, 0x007A, 0x28FA,
+    0x0006, 0x0886, 0x0046, 0x10C6, 0x0026, 0x08A6, 0x0066, 0x18E6,
+    0x0016, 0x0896, 0x0056, 0x10D6, 0x0036, 0x08B6, 0x0076, 0x20F6,
+    0x000E, 0x088E, 0x004E, 0x10CE, 0x002E, 0x08AE, 0x006E, 0x18EE,
+    0x001E, 0x089E, 0x005E, 0x10DE, 0x403E, 0x48BE, 0x407E, 0x78FE,
+    0x0101, 0x0981, 0x0141, 0x11C1, 0x0121, 0x09A1, 0x0161, 0x19E1,
+    0x0111, 0x0991, 0x0151, 0x11D1, 0x0131, 0x09B1, 0x0171, 0x21F1,
+    0x0109, 0x0989, 0x0149, 0x11C9, 0x0129, 0x09A9, 0x0169, 0x19E9,
+    0x0119, 0x0999, 0x0159, 0x11D9, 0x0139, 0x09B9, 0x0179, 0x29F9,
+    0x0105, 0x0985, 0x0145, 0x11C5, 0x0125, 0x09A5, 0x0165, 0x19E5,
+    0x0115, 0x0995, 0x0155, 0x11D5, 0x0135, 0x09B5, 0x0175, 0x21F5,
+    0x010D, 0x098D, 0x014D, 0x11CD, 0x012D, 0x09AD, 0x016D, 0x19ED,
+    0x011D, 0x099D, 0x015D, 0x11DD, 0x013D, 0x09BD, 0x417D, 0x31FD,
+    0x0203, 0x0A83, 0x0243, 0x12C3, 0x0223, 0x0AA3, 0x0263, 0x1AE3,
+    0x0213, 0x0A93, 0x0253, 0x12D3, 0x0233, 0x0AB3, 0x0273, 0x22F3,
+    0x020B, 0x0A8B, 0x024B, 0x12CB, 0x022B, 0x0AAB, 0x026B, 0x1AEB,
+    0x021B, 0x0A9B, 0x025B, 0x12DB, 0x023B, 0x0ABB, 0x027B, 0x2AFB,
+    0x0307, 0x0B87, 0x0347, 0x13C7, 0x0327, 0x0BA7, 0x0367, 0x1BE7,
+    0x0317, 0x0B97, 0x0357, 0x13D7, 0x0337, 0x0BB7, 0x0377, 0x23F7,
+    0x040F, 0x0C8F, 0x044F, 0x14CF, 0x042F, 0x0CAF, 0x046F, 0x1CEF,
+    0x051F, 0x0D9F, 0x055F, 0x15DF, 0x053F, 0x0DBF, 0x057F, 0x7DFF,
+}; STATIC_ASSERT(countof(hdlc_table) == 256);
+
+static void hdlcParseByte(Afsk *afsk, Demod *demod, uint8_t bits) {
+    Hdlc *hdlc = &demod->hdlc;
+    // The parser always holds the last eight bits,
+    // so the ones the previous byte ended with are
+    // in the table too.
+    uint8_t ones = HDLC_TABLE_TRAIL(pgm_read16(&hdlc_table[hdlc->demodulatedBits]));
+    uint16_t entry = pgm_read16(&hdlc_table[bits]);
+
+    if (!(entry & HDLC_TABLE_SPECIAL) && ones + HDLC_TABLE_LEAD(entry) < HDLC_TABLE_MAX_ONES) {
+        // Eight plain bits of data
+        hdlc->demodulatedBits = bits;
+        if (hdlc->receiving) {
+            // The byte we are receiving has bitIndex bits
+            // already, sitting just below the top bit, so
+            // we add the new ones above them. That gives
+            // us one complete byte, and the same number
+            // of bits left over for the next one.
+            uint8_t index = hdlc->bitIndex;
+            uint16_t acc = (hdlc->currentByte >> (7 - index)) | ((uint16_t)HDLC_TABLE_DATA(entry) << index);
+            hdlc->currentByte = (uint8_t)((acc >> 8) << (7 - index));
+            hdlcCountByte(hdlc);
+            hdlcFound(afsk, demod, acc & 0xFF);
+        }
+    } else if (bits == 0xFF && ones >= 7) {
+        // Nothing but ones after an abort. This is
+        // what silence looks like, so it's worth not
+        // going through it a bit at a time.
+        hdlc->demodulatedBits = bits;
+        hdlc->receiving = false;
+        hdlcFound(afsk, demod, HDLC_GOT_RESET);
+    } else {
+        for (uint8_t mask = 0x80; mask; mask >>= 1) {
+            hdlcFound(afsk, demod, hdlcParse(hdlc, bits & mask));
+        }
+    }
+}
+
+#endif
+
+#if CONFIG_AFSK_CORRELATOR
+
+// One full wave of cosine, scaled to fit an int8_t
+static const int8_t PROGMEM corr_table[CORR_LEN] =
+{
+     127,  126,  123,  117,  110,  101,   90,   77,   64,   49,   33,   17,
+       0,  -17,  -33,  -49,  -63,  -77,  -90, -101, -110, -117, -123, -126,
+    -127, -126, -123, -117, -110, -101,  -90,  -77,  -64,  -49,  -33,  -17,
+       0,   17,   33,   49,   64,   77,   90,  101,  110,  117,  123,  126,
+}; STATIC_ASSERT(countof(corr_table) == CORR_LEN);
+
+// The product of a sample and the table, scaled back
+// to the size of a sample. Adding a sample to the sums
+// and taking it back out a bit later must give exactly
+// the same value, so this is the only place we do it.
+#define CORR_MUL(sample, index) ((int16_t)((sample) * (int8_t)pgm_read8(&corr_table[(index)])) >> 7)
+
+// Moves a position in the table on by some steps
+INLINE uint8_t corrStep(uint8_t index, uint8_t steps) {
+    index += steps;
+    return (index >= CORR_LEN) ? index - CORR_LEN : index;
+}
+
+// A quick estimate of the length of the vector (i, q),
+// as the longer side plus 3/8 of the shorter one. It is
+// never more than 7% off, and needs no multiplications,
+// which suits the AVR better than a square root.
+INLINE uint16_t corrMagnitude(int16_t i, int16_t q) {
+    uint16_t a = (i < 0) ? -i : i;
+    uint16_t b = (q < 0) ? -q : q;
+    if (a < b) { uint16_t t = a; a = b; b = t; }
+    return a + (b >> 2) + (b >> 3);
+}
+
+// demodCorrelate ////////////////////////////////////
+// Instead of comparing the signal to itself half a
+// bit ago, like the discriminator does, we compare
+// the last bit worth of samples to a mark tone and a
+// space tone, and see which one it looks more like.
+// Each tone is correlated with a cosine and a sine,
+// so that the phase of the incoming tone doesn't
+// matter, and the sums slide along a sample at a time:
+// the newest sample is added and the oldest one,
+// which is still in the delay line, taken back out.
+//
+// Radios rarely pass both tones at the same level,
+// which is called twist. The space tone is scaled by
+// a gain that corrLearnTwist adjusts, so the decision
+// is made in the middle between them, whatever the
+// twist is.
+//
+// Returns the soft decision: positive for a mark,
+// negative for a space, and larger the surer it is.
+static int16_t demodCorrelate(Afsk *afsk, Demod *demod, int8_t currentSample) {
+    int8_t oldest = demod->delayBuf[(demod->delayIndex - PROFILE_SAMPLESPERBIT(afsk)) & (DEMOD_DELAY_LEN - 1)];
+    uint8_t mark = demod->markPhase;
+    uint8_t space = demod->spacePhase;
+    uint8_t markBack = corrStep(mark, PROFILE_CORR_MARK_BACK(afsk));
+    uint8_t spaceBack = corrStep(space, PROFILE_CORR_SPACE_BACK(afsk));
+
+    demod->markI += CORR_MUL(currentSample, mark) - CORR_MUL(oldest, markBack);
+    demod->markQ += CORR_MUL(currentSample, corrStep(mark, CORR_QUARTER))
+                  - CORR_MUL(oldest, corrStep(markBack, CORR_QUARTER));
+    demod->spaceI += CORR_MUL(currentSample, space) - CORR_MUL(oldest, spaceBack);
+    demod->spaceQ += CORR_MUL(currentSample, corrStep(space, CORR_QUARTER))
+                   - CORR_MUL(oldest, corrStep(spaceBack, CORR_QUARTER));
+
+    demod->markPhase = corrStep(mark, PROFILE_CORR_MARK_STEP(afsk));
+    demod->spacePhase = corrStep(space, PROFILE_CORR_SPACE_STEP(afsk));
+
+    uint16_t markMag = corrMagnitude(demod->markI, demod->markQ);
+    uint16_t spaceMag = ((uint32_t)corrMagnitude(demod->spaceI, demod->spaceQ) * demod->spaceGain) >> 8;
+
+    demod->soft = (int16_t)markMag - (int16_t)spaceMag;
+    return demod->soft;
+}
+
+// corrLearnTwist ////////////////////////////////////
+// Called once per bit, when the sums cover just that
+// bit, with the tone we decided it was. We keep track
+// of how sure we were of marks and of spaces, and
+// nudge the space gain until we are about as sure of
+// both, which puts the decision right in the middle
+// between them. Doing this only in the middle of a
+// bit, rather than on every sample, keeps the half
+// mark, half space samples around the transitions out
+// of the averages.
+//
+// Note that this is not the same as making both tones
+// equally strong. Each tone also leaks a little into
+// the other correlator, and the weaker tone has more
+// noise for its size, so evening out the decisions is
+// what actually gets the most bits right.
+static void corrLearnTwist(Demod *demod, bool mark) {
+    // Only learn the twist from something that looks
+    // like a real signal, noise would just pull the
+    // gain around. Without one, we forget the levels
+    // and slowly go back to no correction, so a gain
+    // that went wrong can't keep us from ever picking
+    // up a signal again.
+    if (demod->dcd < DCD_ON) {
+        demod->markLevel = 0;
+        demod->spaceLevel = 0;
+        if (demod->spaceGain < CORR_GAIN_ONE) demod->spaceGain++;
+        if (demod->spaceGain > CORR_GAIN_ONE) demod->spaceGain--;
+        return;
+    }
+
+    // The first time we see each tone, we take its
+    // level as it is, and average from there on.
+    if (mark) {
+        int16_t level = demod->soft;
+        if (!demod->markLevel) demod->markLevel = level;
+        demod->markLevel += (level - demod->markLevel) >> CORR_LEVEL_SHIFT;
+    } else {
+        int16_t level = -demod->soft;
+        if (!demod->spaceLevel) demod->spaceLevel = level;
+        demod->spaceLevel += (level - demod->spaceLevel) >> CORR_LEVEL_SHIFT;
+    }
+
+    // Until we have seen both, there is nothing to compare
+    if (!demod->markLevel || !demod->spaceLevel) return;
+
+    // More gain for space makes marks less sure,
+    // and spaces more.
+    if (demod->markLevel > demod->spaceLevel) {
+        if (demod->spaceGain < CORR_GAIN_MAX) demod->spaceGain += CORR_GAIN_STEP;
+    } else if (demod->markLevel < demod->spaceLevel) {
+        if (demod->spaceGain > CORR_GAIN_MIN) demod->spaceGain -= CORR_GAIN_STEP;
+    }
+}
+
+// The bank of demodulators splits mark and space at
+// different levels. The correlator gives smaller
+// numbers than the discriminator, so we scale them.
+#define CORR_THRESHOLD(demod) (DEMOD_THRESHOLD(demod) >> 4)
+
+#endif
+
+#if CONFIG_AFSK_SOFT_BITS
+
+// The soft decision, how far the output of the filter
+// or correlator is from where we split mark and space,
+// and how much to scale it down to fit in a byte.
+#if CONFIG_AFSK_CORRELATOR
+#define SOFT_VALUE(demod)   ((int32_t)(demod)->soft - CORR_THRESHOLD(demod))
+#define SOFT_SHIFT          2
+#else
+#define SOFT_VALUE(demod)   ((int32_t)(demod)->iirY[1] - DEMOD_THRESHOLD(demod))
+#define SOFT_SHIFT          5
+#endif
+
+// softConf //////////////////////////////////////////
+// Works out how sure we are of the bit we just
+// sampled, from 0 for not at all to 255. That is how
+// far the soft decision is from the threshold, unless
+// the samples we decided the bit from didn't all
+// agree, in which case we can't be very sure at all.
+INLINE uint8_t softConf(Demod *demod, uint8_t bits) {
+    if (bits != 0x00 && bits != 0x07) return 0;
+    int32_t soft = SOFT_VALUE(demod);
+    uint32_t conf = (uint32_t)(soft < 0 ? -soft : soft) >> SOFT_SHIFT;
+    return conf > 255 ? 255 : conf;
+}
+
+#endif
+
+#if CONFIG_AFSK_PLL
+
+// The phase counter and the fraction bits below it,
+// put together so the loop can work on them
+#define PLL_PHASE(demod) ((int16_t)(demod)->currentPhase * (1 << PLL_FRAC) + (demod)->phaseFrac)
+
+INLINE void pllSetPhase(Demod *demod, int16_t phase) {
+    demod->currentPhase = phase >> PLL_FRAC;
+    demod->phaseFrac = phase & ((1 << PLL_FRAC) - 1);
+}
+
+// pllTransition /////////////////////////////////////
+// Pulls the bit clock towards a transition we just
+// saw. Until the loop is locked, it takes out half of
+// the error each time, so it pulls in within a few
+// flags of the preamble. Once locked, it only takes
+// out a little, so one noisy transition can't throw
+// it far off, and it learns how fast the transmitter
+// clock runs compared to ours, so it keeps up with it
+// between transitions too.
+static void pllTransition(Demod *demod) {
+    int16_t phase = PLL_PHASE(demod);
+    int16_t error = phase - ((int16_t)PHASE_THRESHOLD << PLL_FRAC);
+
+    // Keep count of how close the transitions
+    // come to where we expect them
+    if (error > -PLL_LOCK_WINDOW && error < PLL_LOCK_WINDOW) {
+        if (demod->pllLock < PLL_LOCK_MAX) demod->pllLock += PLL_LOCK_GOOD;
+    } else {
+        demod->pllLock = (demod->pllLock > PLL_LOCK_BAD) ? demod->pllLock - PLL_LOCK_BAD : 0;
+    }
+
+    if (PLL_LOCKED(demod)) {
+        phase -= error >> PLL_TRACK_SHIFT;
+        demod->pllFreq -= error >> PLL_FREQ_SHIFT;
+        if (demod->pllFreq > PLL_FREQ_MAX) demod->pllFreq = PLL_FREQ_MAX;
+        if (demod->pllFreq < -PLL_FREQ_MAX) demod->pllFreq = -PLL_FREQ_MAX;
+    } else {
+        // While we look for a signal, forget the
+        // clock offset of the last one, slowly
+        phase -= error >> PLL_ACQ_SHIFT;
+        demod->pllFreq -= demod->pllFreq >> 3;
+    }
+
+    pllSetPhase(demod, phase);
+}
+
+#endif
+
+// demodSample ///////////////////////////////////////
+// This is where the actual demodulation happens. It is
+// run once for each sample, for each demodulator. The
+// job of this routine is to detect whether we have a
+// "mark" or "space" frequency present on the baseband
+// (the physical medium). The result of this analysis
+// will then be passed to the HDLC parser in form of a
+// 1 or a 0
+static void demodSample(Afsk *afsk, Demod *demod, int8_t currentSample) {
+    #if CONFIG_AFSK_CORRELATOR
+    // Find out if this looks more like mark or space
+    int16_t soft = demodCorrelate(afsk, demod, currentSample);
+
+    // We put the sampled bit in a delay-line, the
+    // same way as for the discriminator below
+    demod->sampledBits <<= 1;
+    demod->sampledBits |= (soft > CORR_THRESHOLD(demod)) ? 1 : 0;
+    #else
     // To determine the received frequency, and thereby
     // the bit of the sample, we multiply the sample by
     // a sample delayed by (samples per bit / 2).
     // We then lowpass-filter the samples with a
     // Chebyshev filter. The lowpass filtering serves
     // to "smooth out" the variations in the samples.
+    demod->iirX[0] = demod->iirX[1];
+
+    #if CONFIG_AFSK_G3RUH
+    if (PROFILE_BASEBAND(afsk)) {
+        // At 9600 baud, the level of the audio is
+        // the bit, so we only filter the samples.
+        demod->iirX[1] = (int16_t)currentSample << G3RUH_INPUT_SHIFT;
+    } else
+    #endif
+    {
+        int8_t delayed = demod->delayBuf[(demod->delayIndex - DEMOD_DELAY(demod)) & (DEMOD_DELAY_LEN - 1)];
+        demod->iirX[1] = (delayed * currentSample) >> PROFILE_PRODUCT_SHIFT(afsk);
+    }
 
-    afsk->iirX[0] = afsk->iirX[1];
-    afsk->iirX[1] = ((int8_t)fifo_pop(&afsk->delayFifo) * currentSample) >> 2;
-
-    afsk->iirY[0] = afsk->iirY[1];
+    demod->iirY[0] = demod->iirY[1];
     
-    afsk->iirY[1] = afsk->iirX[0] + afsk->iirX[1] + (afsk->iirY[0] >> 1); // Chebyshev filter
+    demod->iirY[1] = demod->iirX[0] + demod->iirX[1] + DEMOD_FEEDBACK(demod, demod->iirY[0]); // Chebyshev filter
 
 
     // We put the sampled bit in a delay-line:
     // First we bitshift everything 1 left
-    afsk->sampledBits <<= 1;
+    demod->sampledBits <<= 1;
     // And then add the sampled bit to our delay line
-    afsk->sampledBits |= (afsk->iirY[1] > 0) ? 1 : 0;
+    demod->sampledBits |= (demod->iirY[1] > DEMOD_THRESHOLD(demod)) ? 1 : 0;
+    #endif
 
-    // Put the current raw sample in the delay FIFO
-    fifo_push(&afsk->delayFifo, currentSample);
+    // Put the current raw sample in the delay line
+    demod->delayBuf[demod->delayIndex] = currentSample;
+    demod->delayIndex = (demod->delayIndex + 1) & (DEMOD_DELAY_LEN - 1);
+
+    #if CONFIG_AFSK_DEMODULATORS > 1
+    demod->time++;
+    #endif
 
     // We need to check whether there is a signal transition.
     // If there is, we can recalibrate the phase of our 
@@ -335,61 +1589,107 @@ void afsk_adc_isr(Afsk *afsk, int8_t currentSample) {
     //
     // Every time we detect a signal transition, we adjust
     // where this window is positioned little. How much we
-    // adjust it is defined by PHASE_INC. If our current phase
-    // phase counter value is less than half of PHASE_MAX (ie, 
-    // the window size) when a signal transition is detected,
-    // add PHASE_INC to our phase counter, effectively moving
-    // the window a little bit backward (to the left in the
-    // illustration), inversely, if the phase counter is greater
-    // than half of PHASE_MAX, we move it forward a little.
-    // This way, our "window" is constantly seeking to position
-    // it's center at the bit transitions. Thus, we synchronise
-    // our timing to the transmitter, even if it's timing is
-    // a little off compared to our own.
-    if (SIGNAL_TRANSITIONED(afsk->sampledBits)) {
-        if (afsk->currentPhase < PHASE_THRESHOLD) {
-            afsk->currentPhase += PHASE_INC;
+    // adjust it is defined by the phaseInc of the demodulator.
+    // If our current phase counter value is less than half of
+    // PHASE_MAX (ie, the window size) when a signal transition
+    // is detected, add phaseInc to our phase counter,
+    // effectively moving the window a little bit backward (to
+    // the left in the illustration), inversely, if the phase
+    // counter is greater than half of PHASE_MAX, we move it
+    // forward a little. This way, our "window" is constantly
+    // seeking to position it's center at the bit transitions.
+    // Thus, we synchronise our timing to the transmitter, even
+    // if it's timing is a little off compared to our own.
+    if (SIGNAL_TRANSITIONED(demod->sampledBits)) {
+        // Keep count of how well the transitions
+        // line up, for carrier detect
+        if (demod->currentPhase > PHASE_THRESHOLD - DCD_WINDOW &&
+            demod->currentPhase < PHASE_THRESHOLD + DCD_WINDOW) {
+            if (demod->dcd < DCD_MAX) demod->dcd += DCD_GOOD;
         } else {
-            afsk->currentPhase -= PHASE_INC;
+            demod->dcd = (demod->dcd > DCD_BAD) ? demod->dcd - DCD_BAD : 0;
         }
+
+        #if CONFIG_AFSK_PLL
+        pllTransition(demod);
+        #else
+        if (demod->currentPhase < PHASE_THRESHOLD) {
+            demod->currentPhase += DEMOD_PHASE_INC(demod);
+        } else {
+            demod->currentPhase -= DEMOD_PHASE_INC(demod);
+        }
+        #endif
     }
 
     // We increment our phase counter
-    afsk->currentPhase += PHASE_BITS;
+    demod->currentPhase += PROFILE_PHASE_BITS(afsk);
 
     // Check if we have reached the end of
     // our sampling window.
-    if (afsk->currentPhase >= PHASE_MAX) {
+    if (demod->currentPhase >= PHASE_MAX) {
         // If we have, wrap around our phase
         // counter by modulus
-        afsk->currentPhase %= PHASE_MAX;
+        demod->currentPhase %= PHASE_MAX;
+
+        #if CONFIG_AFSK_PLL
+        // Once a bit, make up for the difference
+        // between our clock and the transmitter's
+        pllSetPhase(demod, PLL_PHASE(demod) + demod->pllFreq);
+        #endif
 
         // Bitshift to make room for the next
         // bit in our stream of demodulated bits
-        afsk->actualBits <<= 1;
+        demod->actualBits <<= 1;
 
         // We determine the actual bit value by reading
         // the last 3 sampled bits. If there is three or
         // more 1's, we will assume that the transmitter
         // sent us a one, otherwise we assume a zero
-        uint8_t bits = afsk->sampledBits & 0x07;
+        uint8_t bits = demod->sampledBits & 0x07;
         if (bits == 0x07 || // 111
             bits == 0x06 || // 110
             bits == 0x05 || // 101
             bits == 0x03    // 011
             ) {
-            afsk->actualBits |= 1;
+            demod->actualBits |= 1;
+        }
+
+        #if CONFIG_AFSK_SOFT_BITS
+        demod->bitConf = softConf(demod, bits);
+        #endif
+
+        #if CONFIG_AFSK_G3RUH
+        // At 9600 baud, what we got is scrambled, so
+        // we undo that before the NRZ decoding below
+        if (PROFILE_BASEBAND(afsk)) {
+            bool received = demod->actualBits & 1;
+            demod->actualBits ^= G3RUH_TAPS(demod->lfsr);
+            demod->lfsr = (demod->lfsr << 1) | received;
+        }
+        #endif
+
+        #if CONFIG_AFSK_CORRELATOR
+        // Now is a good time to see how strong the
+        // tone we just got was
+        corrLearnTwist(demod, demod->actualBits & 1);
+        #endif
+
+        // A real signal never holds a tone for more than
+        // seven bits, so if we have eight the same, this
+        // is silence or a dead carrier, not a signal.
+        if (demod->actualBits == 0x00 || demod->actualBits == 0xFF) {
+            demod->dcd = (demod->dcd > DCD_BAD) ? demod->dcd - DCD_BAD : 0;
         }
 
          //// Alternative using five bits ////////////////
-         // uint8_t bits = afsk->sampledBits & 0x0f;
+         // uint8_t bits = demod->sampledBits & 0x0f;
          // uint8_t c = 0;
          // c += bits & BV(1);
          // c += bits & BV(2);
          // c += bits & BV(3);
          // c += bits & BV(4);
          // c += bits & BV(5);
-         // if (c >= 3) afsk->actualBits |= 1;
+         // if (c >= 3) demod->actualBits |= 1;
         /////////////////////////////////////////////////
 
         // Now we can pass the actual bit to the HDLC parser.
@@ -408,16 +1708,177 @@ void afsk_adc_isr(Afsk *afsk, int8_t currentSample) {
         // By combining bit-stuffing with NRZ coding, we ensure
         // that the signal will regularly make transitions
         // that we can use to synchronize our phase.
-        //
-        // We also check the return of the Link Control parser
-        // to check if an error occured.
+        bool bit = !TRANSITION_FOUND(demod->actualBits);
 
-        if (!hdlcParse(&afsk->hdlc, !TRANSITION_FOUND(afsk->actualBits), &afsk->rxFifo)) {
-            afsk->status |= RX_OVERRUN;
+        #if CONFIG_AX25_FX25
+        // Let the first demodulator look for FX.25
+        // blocks before the HDLC parser gets the bit.
+        if (demod == afsk->demod && fx25Bit(afsk, demod, bit)) return;
+        #endif
+
+        #if CONFIG_AFSK_HDLC_TABLE
+        // Collect a byte worth of bits, and then
+        // parse them all in one go.
+        demod->hdlcBits = (demod->hdlcBits << 1) | bit;
+        if (++demod->hdlcBitCount == 8) {
+            demod->hdlcBitCount = 0;
+            hdlcParseByte(afsk, demod, demod->hdlcBits);
         }
+        #else
+        #if CONFIG_AFSK_SOFT_BITS
+        rxFrameNoteBit(demod, bit, demod->bitConf);
+        #endif
+        hdlcFound(afsk, demod, hdlcParse(&demod->hdlc, bit));
+        #endif
     }
 }
 
+// afsk_demod_isr ////////////////////////////////////
+// Runs a single demodulator on a sample. Normally
+// afsk_adc_isr takes care of this for all of them,
+// but this lets the host build spread them out over
+// several threads.
+void afsk_demod_isr(Afsk *afsk, uint8_t index, int8_t currentSample) {
+    ASSERT(index < CONFIG_AFSK_DEMODULATORS);
+    demodSample(afsk, &afsk->demod[index], currentSample);
+}
+
+#if CONFIG_AFSK_AGC
+// afsk_agc //////////////////////////////////////////
+// Levels the audio before the demodulators see it.
+// Instead of taking the top 8 bits of the ADC and
+// subtracting the 128 the bias should be at, this
+// keeps track of where the bias actually is and takes
+// that out, and then scales what is left so the
+// peaks end up between AGC_LOW and AGC_HIGH. Quiet
+// audio gets to use the bottom two bits of the ADC
+// too, and loud audio doesn't clip.
+int8_t afsk_agc(Afsk *afsk, uint16_t adc) {
+    // Take out the offset, and move it a little
+    // towards this reading. Both are kept in 1/32
+    // steps, so the offset can move slowly.
+    int16_t sample = (int16_t)(adc << AGC_OFFSET_FRAC) - (int16_t)afsk->agcOffset;
+    #if CONFIG_AFSK_G3RUH
+    // At 9600 baud the samples come four times as
+    // fast, and the offset must still move as slowly
+    // in time, or it would eat the long runs of one
+    // level that the scrambler lets through
+    afsk->agcOffset += sample >> (PROFILE_BASEBAND(afsk) ? AGC_OFFSET_SHIFT + 2 : AGC_OFFSET_SHIFT);
+    #else
+    afsk->agcOffset += sample >> AGC_OFFSET_SHIFT;
+    #endif
+
+    #if CONFIG_AFSK_TELEMETRY
+    // The ADC reading is clipped if it is at
+    // either end of the range
+    if ((adc == 0 || adc >= 1023) && afsk->stats.clipped < UINT16_MAX) afsk->stats.clipped++;
+    #endif
+
+    // Scale the sample down to 8 bits with the gain
+    int16_t scaled = ((int32_t)sample * afsk->agcGain) >> AGC_SCALE_SHIFT;
+    if (scaled > 127) scaled = 127;
+    if (scaled < -128) scaled = -128;
+
+    // Keep track of the peak level, which follows
+    // the audio up right away and down slowly
+    uint16_t level = (uint16_t)(scaled < 0 ? -scaled : scaled) << 8;
+    if (level > afsk->agcPeak) {
+        afsk->agcPeak = level;
+    } else {
+        afsk->agcPeak -= afsk->agcPeak >> AGC_PEAK_DECAY;
+    }
+
+    // And adjust the gain if the peaks are out of
+    // range. The peak we remember is scaled along
+    // with it, so we don't keep turning the gain
+    // down while the old peak slowly fades.
+    if (afsk->agcPeak > AGC_HIGH && afsk->agcGain > AGC_GAIN_MIN) {
+        afsk->agcGain -= afsk->agcGain >> AGC_ATTACK;
+        afsk->agcPeak -= afsk->agcPeak >> AGC_ATTACK;
+    } else if (afsk->agcPeak < AGC_LOW && afsk->agcGain < AGC_GAIN_MAX) {
+        afsk->agcGain += afsk->agcGain >> AGC_RELEASE;
+        afsk->agcPeak += afsk->agcPeak >> AGC_RELEASE;
+    }
+
+    return scaled;
+}
+
+void afsk_agcLevels(Afsk *afsk, uint16_t *offset, uint16_t *gain) {
+    ATOMIC(
+        *offset = afsk->agcOffset >> AGC_OFFSET_FRAC;
+        *gain = afsk->agcGain;
+    );
+}
+#endif
+
+#if CONFIG_AFSK_TELEMETRY
+// Keeps count of the level of the received audio,
+// and of how much of the time there is a signal
+INLINE void statsSample(Afsk *afsk, int8_t sample) {
+    AfskStats *stats = &afsk->stats;
+    uint8_t level = sample < 0 ? -(int16_t)sample : sample;
+    if (level > stats->peak) stats->peak = level;
+
+    #if !CONFIG_AFSK_AGC
+    // Without the AGC, the sample is what the ADC
+    // read, so we can tell if it was clipped here
+    if ((sample == -128 || sample == 127) && stats->clipped < UINT16_MAX) stats->clipped++;
+    #endif
+
+    stats->samples++;
+    if (afsk_dcd(afsk)) stats->busy++;
+}
+
+void afsk_getStats(Afsk *afsk, AfskStats *copy) {
+    ATOMIC(
+        *copy = afsk->stats;
+        copy->frames = afsk->demod[0].hdlc.frames;
+        copy->aborts = afsk->demod[0].hdlc.aborts;
+    );
+}
+
+void afsk_resetStats(Afsk *afsk) {
+    ATOMIC(
+        memset(&afsk->stats, 0, sizeof(afsk->stats));
+        for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+            afsk->demod[i].hdlc.frames = 0;
+            afsk->demod[i].hdlc.aborts = 0;
+        }
+    );
+}
+#endif
+
+// adcISR ////////////////////////////////////////////
+// This is the Interrupt Service Routine for the
+// Analog to Digital Conversion. It is called 9600
+// times each second to analyze the sample taken from
+// the physical medium, which we hand to each of our
+// demodulators in turn.
+void afsk_adc_isr(Afsk *afsk, int8_t currentSample) {
+    for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+        demodSample(afsk, &afsk->demod[i], currentSample);
+    }
+
+    #if CONFIG_AFSK_TELEMETRY
+    statsSample(afsk, currentSample);
+    #endif
+
+    // If there is something waiting to be sent,
+    // we see if we can have the channel
+    if (afsk->txPending) {
+        afsk_csma(afsk, currentSample);
+    }
+}
+
+// Tells whether there is a signal on the channel,
+// going by how sure the demodulators are of it
+bool afsk_dcd(Afsk *afsk) {
+    for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+        if (afsk->demod[i].dcd >= DCD_ON) return true;
+    }
+    return false;
+}
+
 //////////////////////////////////////////////////////
 // Signal modulation and DAC                        //
 //////////////////////////////////////////////////////
@@ -426,179 +1887,347 @@ void afsk_adc_isr(Afsk *afsk, int8_t currentSample) {
 // before we need to "stuff" in a zero
 #define BIT_STUFF_LEN 5
 
-// A macro for switching what tone is being
-// synthesized by the DAC. We basically just
-// change how quickly we go through the sine
-// table each time we send out a sample. This
-// is done by changing the phaseInc variable
-#define SWITCH_TONE(inc)  (((inc) == MARK_INC) ? SPACE_INC : MARK_INC)
+// The tones we send are kept as bits, a one for the
+// mark tone and a zero for the space tone, first one
+// in the least significant bit. On top of them sits
+// a single one bit, so we know when a byte has been
+// sent without keeping count: when only that bit is
+// left, we are done.
+#define TX_BITS_END 1
+
+// Each time the DAC ISR needs a new bit, it has only
+// to pick the tone, and thereby how quickly we go
+// through the sine table each time we send out a
+// sample. This is done by changing phaseInc.
+#define TONE_INC(afsk, bits) (((bits) & 1) ? PROFILE_MARK_INC(afsk) : PROFILE_SPACE_INC(afsk))
+
+// The tones for an HDLC_FLAG, when the last tone we
+// sent is the mark tone. The preamble and tail are
+// nothing but flags, so the DAC ISR makes those
+// itself instead of us filling up the buffer with
+// them. Since a flag starts and ends with a zero, it
+// switches tone once, holds it for six bits and
+// switches back. If we were sending the space tone,
+// the tones are simply flipped.
+#define FLAG_TONES  0x80
+#define FLAG_TONES_FROM(tone) (((tone) ? FLAG_TONES : (uint8_t)~FLAG_TONES) | BV(8))
+
+// The transmit buffer holds the encoded tones packed
+// eight to a byte, so a whole frame fits in not much
+// more RAM than the frame itself. The positions in it
+// count tones, and wrap around at TX_TONES.
+#define TX_TONES ((TxIndex)(CONFIG_AFSK_TX_BUFLEN * 8))
+
+// The most tones one byte can be encoded into, when
+// bit stuffing adds a zero after each five ones
+#define TX_BYTE_TONES 10
+
+// The main loop changes txHead while the DAC ISR may
+// be reading it. The positions are more than a byte,
+// so the ISR could see half of a change, and it must
+// be atomic.
+#define TX_INDEX_ATOMIC(code) ATOMIC(code)
+
+// How many tones are waiting in the buffer
+#define TX_USED(head, tail) ((TxIndex)((head) >= (tail) ? (head) - (tail) : (head) + TX_TONES - (tail)))
+
+// txPush ////////////////////////////////////////////
+// Puts the tones of an encoded byte in the transmit
+// buffer, waiting for the DAC ISR to make room for
+// them if it is full. Only the main loop writes
+// txHead, and only the ISR writes txTail, so we don't
+// need to lock anything. The ISR may read the byte we
+// are adding tones to, but only the tones before
+// txHead, which we write back as they were.
+static void txPush(Afsk *afsk, uint16_t bits, uint8_t count) {
+    TxIndex head = afsk->txHead;
+    TxIndex tail;
+    for (;;) {
+        TX_INDEX_ATOMIC(tail = afsk->txTail);
+        if (TX_USED(head, tail) + count < TX_TONES) break;
+        // If the transmitter is being held back,
+        // we have to key up now anyway, or nothing
+        // will ever make room in the buffer.
+        afsk_txKey(afsk);
+        #if CONFIG_AFSK_TX_QUEUE_LEN
+        // If the ISR has sent every complete frame,
+        // the one we are encoding is too big to ever
+        // fit, so we let the ISR have it as we go.
+        if (tail == afsk->txCommit) {
+            afsk->txStreaming = true;
+            TX_INDEX_ATOMIC(afsk->txCommit = head);
+        }
+        #endif
+        cpu_relax();
+    }
 
-// This function starts the transmission
+    while (count--) {
+        if (bits & 1) {
+            afsk->txBuf[head >> 3] |= BV(head & 7);
+        } else {
+            afsk->txBuf[head >> 3] &= ~BV(head & 7);
+        }
+        bits >>= 1;
+        if (++head == TX_TONES) head = 0;
+    }
+    #if CONFIG_AFSK_TX_QUEUE_LEN
+    TX_INDEX_ATOMIC(
+        afsk->txHead = head;
+        if (afsk->txStreaming) afsk->txCommit = head;
+    );
+    #else
+    TX_INDEX_ATOMIC(afsk->txHead = head);
+    #endif
+}
+
+// txPop /////////////////////////////////////////////
+// Takes the next tone out of the transmit buffer, for
+// the DAC ISR. It is returned the way the ISR keeps
+// the tones of a flag, with TX_BITS_END on top.
+INLINE uint16_t txPop(Afsk *afsk) {
+    TxIndex tail = afsk->txTail;
+    uint16_t tone = (afsk->txBuf[tail >> 3] >> (tail & 7)) & 1;
+    if (++tail == TX_TONES) tail = 0;
+    afsk->txTail = tail;
+    return tone | BV(1);
+}
+
+// txEncode //////////////////////////////////////////
+// This is where we turn the bytes we want to send into
+// the tones that the DAC ISR will play. This happens
+// in the main loop, so the ISR has as little as
+// possible to do.
+static void txEncode(Afsk *afsk, uint8_t byte, bool stuff) {
+    uint16_t bits = 0;
+    uint8_t count = 0;
+
+    for (uint8_t mask = 0x01; mask; mask <<= 1) {
+        // We are using NRZ so if we want to transmit a 1
+        // the modulated signal will stay the same. For a 0
+        // we make the signal transition.
+        if (byte & mask) {
+            // We don't do anything, aka stay on the same
+            // tone as before. We have sent one 1, so we
+            // increment the bitstuff counter.
+            afsk->txOnes++;
+        } else {
+            // We switch the tone, and reset the bitstuff
+            // counter, since we have now transmitted a
+            // zero
+            afsk->txOnes = 0;
+            afsk->txTone = !afsk->txTone;
+        }
+        bits |= (uint16_t)afsk->txTone << count++;
+
+        // If we are allowed to bit-stuff, and we have
+        // reached the maximum number of consecutive
+        // ones, we'll reset the bit-stuff counter and
+        // insert a zero into the bitstream
+        if (stuff && afsk->txOnes >= BIT_STUFF_LEN) {
+            afsk->txOnes = 0;
+            afsk->txTone = !afsk->txTone;
+            bits |= (uint16_t)afsk->txTone << count++;
+        }
+    }
+
+    // A flag is never stuffed, and always ends
+    // in a zero, so we start counting over.
+    if (!stuff) afsk->txOnes = 0;
+
+    txPush(afsk, bits, count);
+}
+
+// This function gets the encoder ready for the next
+// byte. Keying up the transmitter is done separately,
+// since it can be held back until a frame is complete.
 static void afsk_txStart(Afsk *afsk) {
-    if (!afsk->sending) {
+    // If nothing is being sent, and nothing is
+    // waiting to be, we start a new transmission
+    if (!afsk->sending && afsk->txHead == afsk->txTail) {
         // Initialize the phase increment to
         // that of the mark frequency (zero)
-        afsk->phaseInc = MARK_INC;
-        // Reset the phase accumulator to 0
-        afsk->phaseAcc = 0;
-        // And also the bitstuff counter
-        afsk->bitstuffCount = 0;
-        // Indicate we are now sending
-        afsk->sending = true;
-        // And turn on the blingy LED
-        LED_TX_ON();
-        // We also need to calculate how many HDLC_FLAG
-        // bytes we need to send in preamble
-        afsk->preambleLength = DIV_ROUND(CONFIG_AFSK_PREAMBLE_LEN * BITRATE, 8000);
-        AFSK_DAC_IRQ_START();
-    }
-    // We make the same calculation for the tail length,
-    // but this needs to be atomic, since the txStart
-    // function could potentially be called while we
-    // are already transmitting.
-    ATOMIC(afsk->tailLength = DIV_ROUND(CONFIG_AFSK_TRAILER_LEN * BITRATE, 8000));
+        afsk->phaseInc = PROFILE_MARK_INC(afsk);
+        // And also the encoder
+        afsk->txOnes = 0;
+        afsk->txTone = true;
+        afsk->txEscape = false;
+        afsk->txRaw = false;
+    }
+    // We calculate how many HDLC_FLAG bytes we need
+    // to send in the tail. This needs to be atomic,
+    // since we could already be transmitting.
+    uint16_t tailLength = DIV_ROUND((uint32_t)afsk->tailTime * PROFILE_BITRATE(afsk), 8000);
+    ATOMIC(afsk->tailLength = tailLength);
+}
+
+// This function keys up the transmitter. It is called
+// from the ADC ISR once we have the channel, or right
+// away if we don't need to listen first.
+static void afsk_txKeyNow(Afsk *afsk) {
+    // Reset the phase accumulator to 0, but
+    // keep the tone, which is where the encoder
+    // left off.
+    afsk->phaseAcc = 0;
+    afsk->txBits = TX_BITS_END;
+    #if CONFIG_AFSK_G3RUH
+    afsk->txShape = 0;
+    #endif
+    // We also need to calculate how many HDLC_FLAG
+    // bytes we need to send in preamble
+    afsk->preambleLength = DIV_ROUND((uint32_t)afsk->preambleTime * PROFILE_BITRATE(afsk), 8000);
+    // Indicate we are now sending
+    afsk->txPending = false;
+    afsk->sending = true;
+    // And turn on the blingy LED
+    LED_TX_ON();
+    AFSK_DAC_IRQ_START();
+}
+
+// This function asks for the transmitter to be keyed
+// up, if it is not on already. The ADC ISR does it
+// when the channel is ours, see afsk_csma.
+static void afsk_txKey(Afsk *afsk) {
+    if (afsk->sending || afsk->txPending) return;
+    ATOMIC(
+        if (!afsk->sending && !afsk->txPending) {
+            afsk->slotCount = 0;
+            afsk->txPending = true;
+        }
+    );
+}
+
+// afsk_csma //////////////////////////////////////////
+// This is p-persistent CSMA, called from the ADC ISR
+// for each sample while we have something to send. At
+// the start of each slot, if nobody else is sending,
+// we take the slot with a chance set by persistence.
+// If we don't, or the channel is busy, we wait for the
+// next slot and try again.
+static void afsk_csma(Afsk *afsk, int8_t currentSample) {
+    // Step our random number generator, a 16 bit
+    // LFSR. We stir in the incoming audio when we
+    // use it, so two modems switched on at the same
+    // time don't pick the same slots.
+    afsk->random = (afsk->random >> 1) ^ (-(afsk->random & 1) & 0xB400);
+
+    if (afsk->fullDuplex) {
+        afsk_txKeyNow(afsk);
+    } else if (afsk->slotCount > 0) {
+        afsk->slotCount--;
+    } else {
+        #if CONFIG_AFSK_G3RUH
+        // At 38.4KHz, slots longer than 1.7 seconds
+        // don't fit the counter, but they would be
+        // far too long at 9600 baud anyway.
+        afsk->slotCount = MIN((uint32_t)afsk->slotTime * (PROFILE_SAMPLERATE(afsk) / 100), (uint32_t)UINT16_MAX);
+        #else
+        afsk->slotCount = afsk->slotTime * (SAMPLERATE / 100);
+        #endif
+        if (!afsk_dcd(afsk) && (uint8_t)(afsk->random ^ currentSample) <= afsk->persistence) {
+            afsk_txKeyNow(afsk);
+        }
+    }
+}
+
+// Holds back keying up the transmitter while set, so a
+// frame can be written a byte at a time as it arrives
+// and still go out in one piece. The transmitter is
+// keyed when the hold is released, or if the transmit
+// buffer fills up before that.
+void afsk_txHold(Afsk *afsk, bool hold) {
+    afsk->txHold = hold;
+    if (!hold && afsk->txHead != afsk->txTail) {
+        afsk_txKey(afsk);
+    }
 }
 
 // This is the DAC ISR, called at sampling rate whenever the DAC IRQ is on.
-// It modulates the data to be transmitted and returns a value directly
-// for output on the DAC
+// All the encoding has been done already, so we just play the tones from
+// the transmit buffer, and return a value directly for output on the DAC
 uint8_t afsk_dac_isr(Afsk *afsk) {
-    // Check whether we are at the beginning of a sample
+    // Check whether we are at the beginning of a bit
     if (afsk->sampleIndex == 0) {
-        // If we are, we should figure out what we are
-        // actually going to modulate and transmit :)
-        if (afsk->txBit == 0) {
-            // txBit is a bitmask that is ANDed to the
-            // byte we are sending. It is bitshifted one
-            // position left each time we shift the next
-            // bit. If it is 0, we know we are at the
-            // beginning of the next byte, and nothing
-            // has been transmitted yet.
-
-            // If TX FIFO is empty and tail-length has decremented to 0
-            // we are done, stop the IRQ and reset
-            if (fifo_isempty(&afsk->txFifo) && afsk->tailLength == 0) {
+        // If we have sent all tones of the current
+        // byte, we get the next one.
+        if (afsk->txBits == TX_BITS_END) {
+            if (afsk->preambleLength > 0) {
+                // We are in preamble. We'll decrement
+                // the preamble counter and transmit a
+                // HDLC_FLAG. Since a flag leaves us on the
+                // same tone as we started, the encoder
+                // doesn't need to know about this.
+                afsk->preambleLength--;
+                afsk->txBits = FLAG_TONES_FROM(afsk->phaseInc == PROFILE_MARK_INC(afsk));
+            #if CONFIG_AFSK_TX_QUEUE_LEN
+            } else if (afsk->txTail != afsk->txCommit) {
+                // Otherwise we send whatever is next in
+                // the transmit buffer, but only frames
+                // that have been completely encoded
+                afsk->txBits = txPop(afsk);
+            } else if (afsk->txHead != afsk->txCommit) {
+                // The main loop is still encoding the
+                // next frame. We are between frames, so
+                // we keep the transmitter keyed with
+                // flags until it is done, instead of
+                // going into the tail.
+                afsk->txBits = FLAG_TONES_FROM(afsk->phaseInc == PROFILE_MARK_INC(afsk));
+            #else
+            } else if (afsk->txTail != afsk->txHead) {
+                // Otherwise we send whatever is next in
+                // the transmit buffer
+                afsk->txBits = txPop(afsk);
+            #endif
+            } else if (afsk->tailLength > 0) {
+                // If the buffer is empty, we must be in the
+                // TX tail then. Decrement the tail counter
+                // and send a HDLC_FLAG
+                afsk->tailLength--;
+                afsk->txBits = FLAG_TONES_FROM(afsk->phaseInc == PROFILE_MARK_INC(afsk));
+            } else {
+                // If the buffer is empty and tail-length has
+                // decremented to 0 we are done, stop the IRQ
                 AFSK_DAC_IRQ_STOP();
                 afsk->sending = false;
                 LED_TX_OFF();
                 return 0;
-            } else {
-                // Reset the bitstuff counter if we have just sent
-                // a bitstuffed byte
-                if (!afsk->bitStuff) afsk->bitstuffCount = 0;
-                // Reset bitstuff indicator to true, signifying
-                // that it's ok to bit stuff.
-                afsk->bitStuff = true;
-
-                // Check if we are in preamble or tail
-                if (afsk->preambleLength == 0) {
-                    // We are not in preamble
-                    if (fifo_isempty(&afsk->txFifo)) {
-                        // If the TX buffer is empty, we must
-                        // be in the TX tail then.
-                        // Decrement the tail counter and send
-                        // a HDLC_FLAG
-                        afsk->tailLength--;
-                        afsk->currentOutputByte = HDLC_FLAG;
-                    } else {
-                        // If preamble is already transmitted and TX
-                        // buffer is not empty, we should get a byte
-                        // for transmission
-                        afsk->currentOutputByte = fifo_pop(&afsk->txFifo);
-                    }
-                } else {
-                    // We are in preamble. We'll decrement
-                    // the preamble counter and transmit a
-                    // HDLC_FLAG
-                    afsk->preambleLength--;
-                    afsk->currentOutputByte = HDLC_FLAG;
-                }
-
-                // This handles escape sequences and control
-                // characters. First we check if the current
-                // byte is an escape character. If it is, we
-                // know the next byte, even though it looks
-                // like an HDLC control character, in fact is
-                // not. Therefore we'll fetch it and transmit
-                // it as data using bit stuffing.
-                if (afsk->currentOutputByte == AX25_ESC) {
-                    // First make sure that the TX buffer is
-                    // not empty for some strange reason
-                    if (fifo_isempty(&afsk->txFifo)) {
-                        AFSK_DAC_IRQ_STOP();
-                        afsk->sending = false;
-                        LED_TX_OFF();
-                        return 0;
-                    } else {
-                        // If it is not, fetch the next byte
-                        afsk->currentOutputByte = fifo_pop(&afsk->txFifo);
-                    }
-                } else if (afsk->currentOutputByte == HDLC_FLAG || afsk->currentOutputByte == HDLC_RESET) {
-                    // If there was not an escape character and
-                    // this byte is an HDLC control character,
-                    // we know that it is an _actual_ control
-                    // character, and we indicate that it should
-                    // not be bitstuffed.
-                    afsk->bitStuff = false;
-                }
-            }
-            // Since we are at the beginning of a byte,
-            // we'll initialize the txBit mask to:
-            // 00000001. It will then be bit-shifted one
-            // position to the left each time we send the
-            // next bit. By ANDing this mask to the byte
-            // we are sending, we can quickly figure out
-            // what tone we should transmit. For example:
-            // 
-            // If we are sending bit number 4 of the
-            // byte:                      01101011
-            // The bit mask would be:     00001000
-            // If we AND the byte and the
-            // mask, we get:              00001000
-            // Since this is not zero, we know we should
-            // transmit a one.
-            afsk->txBit = 0x01;
-        }
-
-        // First we need to check for bit-stuffing
-        if (afsk->bitStuff && afsk->bitstuffCount >= BIT_STUFF_LEN) {
-            // If we are allowed to bit-stuff, and we have
-            // reached the maximum number of consecutive
-            // ones, we'll reset the bit-stuff counter and
-            // insert a zero into the bitstream
-            afsk->bitstuffCount = 0;
-            afsk->phaseInc = SWITCH_TONE(afsk->phaseInc);
-        } else {
-            // If we don't need to bit-stuff now, we can get
-            // on with the actual transmission.
-            //
-            // We are using NRZ so if we want to transmit a 1
-            // the modulated signal will stay the same. For a 0
-            // we make the signal transition.
-            if (afsk->currentOutputByte & afsk->txBit) {
-                // We don't do anything, aka stay on the same
-                // tone as before. We have sent one 1, so we
-                // increment the bitstuff counter.
-                afsk->bitstuffCount++;
-            } else {
-                // We switch the tone, and reset the bitstuff
-                // counter, since we have now transmitted a
-                // zero
-                afsk->bitstuffCount = 0;
-                afsk->phaseInc = SWITCH_TONE(afsk->phaseInc);
             }
+        }
+
+        // Switch to the tone of this bit
+        afsk->phaseInc = TONE_INC(afsk, afsk->txBits);
 
-            // Bitshift the mast to allow for the next
-            // bit in the byte to be transmitted
-            afsk->txBit <<= 1;
+        #if CONFIG_AFSK_TX_LEVELS
+        // And to the level of that tone
+        afsk->txLevel = (afsk->phaseInc == PROFILE_MARK_INC(afsk)) ? afsk->markLevel : afsk->spaceLevel;
+        #endif
+
+        #if CONFIG_AFSK_G3RUH
+        // At 9600 baud, we scramble the level of the
+        // bit instead, and start sending the bit
+        // before it, now that we know what comes next
+        if (PROFILE_BASEBAND(afsk)) {
+            bool scrambled = (afsk->txBits & 1) ^ G3RUH_TAPS(afsk->txLfsr);
+            afsk->txLfsr = (afsk->txLfsr << 1) | scrambled;
+            afsk->txShape = ((afsk->txShape << 1) | scrambled) & 0x07;
         }
+        #endif
+
+        afsk->txBits >>= 1;
 
         // We set sampleIndex to DAC_SAMPLESPERBIT,
         // so we will transmit this bit for the number
         // of samples one bit requires to transmit at
         // the chosen bitrate.
-        afsk->sampleIndex = DAC_SAMPLESPERBIT;
+        afsk->sampleIndex = PROFILE_DAC_SAMPLESPERBIT(afsk);
+    }
+
+    #if CONFIG_AFSK_G3RUH
+    if (PROFILE_BASEBAND(afsk)) {
+        uint8_t sample = pgm_read8(&g3ruh_shape[afsk->txShape][G3RUH_SAMPLESPERBIT - afsk->sampleIndex]);
+        afsk->sampleIndex--;
+        return sample;
     }
+    #endif
 
     // We increment the phase accumulator
     // by the amount needed for the tone
@@ -608,9 +2237,17 @@ uint8_t afsk_dac_isr(Afsk *afsk) {
     afsk->phaseAcc %= SIN_LEN;
     // Finally we decrement the sample counter
     afsk->sampleIndex--;
+    #if CONFIG_AFSK_TX_LEVELS
+    // ... and return the sample, scaled to the
+    // level of the tone around the middle of
+    // the DAC range
+    int16_t sample = (int16_t)sinSample(afsk->phaseAcc) - 128;
+    return 128 + ((sample * afsk->txLevel) >> 7);
+    #else
     // ... and return the sample to for it to
     // be written out
     return sinSample(afsk->phaseAcc);
+    #endif
 }
 
 
@@ -621,6 +2258,36 @@ uint8_t afsk_dac_isr(Afsk *afsk) {
 // Handy for sending and receiving data :)          //
 //////////////////////////////////////////////////////
 
+#if CONFIG_AFSK_RX_FRAMES
+
+// Read from the modem. When receiving whole frames
+// there is nothing to read this way, they are got
+// with afsk_getFrame instead.
+static size_t afsk_read(KFile *fd, void *_buf, size_t size) {
+    (void)fd;
+    (void)_buf;
+    (void)size;
+    return 0;
+}
+
+// Gets the next received frame, or NULL if there
+// is none. The frame belongs to the caller until it
+// is handed back with afsk_freeFrame.
+AfskFrame *afsk_getFrame(Afsk *afsk) {
+    AfskFrame *frame;
+    ATOMIC(frame = (AfskFrame *)list_remHead(&afsk->rxReady));
+    return frame;
+}
+
+// Hands a frame back to the pool, so it can be
+// received into again
+void afsk_freeFrame(Afsk *afsk, AfskFrame *frame) {
+    (void)afsk;
+    ATOMIC(pool_free(&rxPool, frame));
+}
+
+#else
+
 // Read from the modem
 static size_t afsk_read(KFile *fd, void *_buf, size_t size) {
     Afsk *afsk = AFSK_CAST(fd);
@@ -650,18 +2317,64 @@ static size_t afsk_read(KFile *fd, void *_buf, size_t size) {
     return buffer - (uint8_t *)_buf;
 }
 
-// Write to the modem
+#endif
+
+// txByte ////////////////////////////////////////////
+// Takes one byte written to the modem, and encodes it
+// for the DAC ISR, see txEncode.
+static void txByte(Afsk *afsk, uint8_t c) {
+    afsk_txStart(afsk);
+
+    // This handles escape sequences and control
+    // characters. If the last byte was an escape
+    // character, we know this byte, even though it
+    // might look like an HDLC control character, in
+    // fact is not, so we transmit it as data using
+    // bit stuffing.
+    if (afsk->txEscape) {
+        afsk->txEscape = false;
+        txEncode(afsk, c, true);
+    } else if (afsk->txRaw) {
+        // The byte after an AX25_RAW is sent just
+        // as it is, without any bit stuffing. This
+        // is how FX.25 blocks are sent.
+        afsk->txRaw = false;
+        txEncode(afsk, c, false);
+    } else if (c == AX25_ESC) {
+        afsk->txEscape = true;
+    } else if (c == AX25_RAW) {
+        afsk->txRaw = true;
+    } else {
+        // If there was not an escape character and
+        // this byte is an HDLC control character,
+        // we know that it is an _actual_ control
+        // character, and it should not be bitstuffed.
+        txEncode(afsk, c, c != HDLC_FLAG && c != HDLC_RESET);
+
+        #if CONFIG_AFSK_TX_QUEUE_LEN
+        // A flag ends a frame, so everything up
+        // to here can be handed to the DAC ISR
+        if (c == HDLC_FLAG) {
+            TX_INDEX_ATOMIC(afsk->txCommit = afsk->txHead);
+            afsk->txStreaming = false;
+        }
+        #endif
+    }
+}
+
+// Write to the modem. This is also where the data is
+// encoded for transmission, see txByte.
 static size_t afsk_write(KFile *fd, const void *_buf, size_t size) {
     Afsk *afsk = AFSK_CAST(fd);
     const uint8_t *buf = (const uint8_t *)_buf;
 
     while (size--) {
-        while (fifo_isfull_locked(&afsk->txFifo)) {
-            cpu_relax();
-        }
+        txByte(afsk, *buf++);
+    }
 
-        fifo_push_locked(&afsk->txFifo, *buf++);
-        afsk_txStart(afsk);
+    // Key up, unless we are asked to wait
+    if (!afsk->txHold) {
+        afsk_txKey(afsk);
     }
 
     return buf - (const uint8_t *)_buf;
@@ -670,7 +2383,7 @@ static size_t afsk_write(KFile *fd, const void *_buf, size_t size) {
 // Waits for the write operation to finish
 static int afsk_flush(KFile *fd) {
     Afsk *afsk = AFSK_CAST(fd);
-    while (afsk->sending) {
+    while (afsk->sending || afsk->txPending) {
         cpu_relax();
     }
     return 0;
@@ -696,6 +2409,106 @@ static void afsk_clearerr(KFile *fd) {
 // Modem Initialization                             //
 //////////////////////////////////////////////////////
 
+#if CONFIG_AFSK_PROFILES
+
+// demodLoadProfile //////////////////////////////////
+// Gives each demodulator the settings the current
+// profile has for it. Whatever they have received
+// so far was at another bitrate, so they start over.
+static void demodLoadProfile(Afsk *afsk) {
+    for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+        Demod *demod = &afsk->demod[i];
+        const DemodParams *params = &afsk->profile->demods[i];
+        demod->delay = params->delay;
+        demod->filterGain = params->filterGain;
+        demod->phaseInc = params->phaseInc;
+        demod->threshold = params->threshold;
+        ASSERT(demod->delay < DEMOD_DELAY_LEN);
+
+        memset(demod->delayBuf, 0, sizeof(demod->delayBuf));
+        demod->delayIndex = 0;
+        #if CONFIG_AFSK_CORRELATOR
+        // The sums must match the delay line,
+        // which is all zeroes now
+        demod->markI = demod->markQ = 0;
+        demod->spaceI = demod->spaceQ = 0;
+        demod->markPhase = demod->spacePhase = 0;
+        demod->markLevel = demod->spaceLevel = 0;
+        demod->spaceGain = CORR_GAIN_ONE;
+        #else
+        demod->iirX[0] = demod->iirX[1] = 0;
+        demod->iirY[0] = demod->iirY[1] = 0;
+        #endif
+        demod->sampledBits = 0;
+        demod->currentPhase = 0;
+        #if CONFIG_AFSK_PLL
+        demod->phaseFrac = 0;
+        demod->pllFreq = 0;
+        demod->pllLock = 0;
+        #endif
+        demod->dcd = 0;
+        #if CONFIG_AFSK_G3RUH
+        demod->lfsr = 0;
+        #endif
+        demod->hdlc.receiving = false;
+    }
+}
+
+// Switches the modem to another profile. Changing
+// the tones in the middle of a transmission would
+// garble it, so we let it finish first. Anything
+// still waiting in the transmit buffer goes out at
+// the new bitrate, since it is only stored as tones.
+void afsk_setProfile(Afsk *afsk, uint8_t profile) {
+    ASSERT(profile < AFSK_PROFILES);
+    afsk_flush(&afsk->fd);
+
+    ATOMIC(
+        afsk->profile = &afskProfiles[profile];
+        afsk->phaseInc = PROFILE_MARK_INC(afsk);
+        demodLoadProfile(afsk);
+    );
+
+    #if CONFIG_AFSK_G3RUH
+    AFSK_ADC_RATE(PROFILE_SAMPLERATE(afsk));
+    #endif
+}
+
+uint8_t afsk_getProfile(Afsk *afsk) {
+    return afsk->profile - afskProfiles;
+}
+
+uint16_t afsk_sampleRate(Afsk *afsk) {
+    #if !CONFIG_AFSK_G3RUH
+    // Only G3RUH has a profile with its own rate
+    (void)afsk;
+    #endif
+    return PROFILE_SAMPLERATE(afsk);
+}
+
+#endif
+
+#if CONFIG_AFSK_TX_LEVELS
+// The levels are kept in 1/128ths, so the DAC
+// interrupt can scale with a shift. A level of
+// 128 leaves the samples exactly as they were.
+#define TX_LEVEL_ONE 128
+
+void afsk_setTxLevels(Afsk *afsk, uint8_t mark, uint8_t space) {
+    if (mark > 100) mark = 100;
+    if (space > 100) space = 100;
+    ATOMIC(
+        afsk->markLevel = (mark * TX_LEVEL_ONE + 50) / 100;
+        afsk->spaceLevel = (space * TX_LEVEL_ONE + 50) / 100;
+    );
+}
+
+void afsk_getTxLevels(Afsk *afsk, uint8_t *mark, uint8_t *space) {
+    *mark = (afsk->markLevel * 100 + TX_LEVEL_ONE / 2) / TX_LEVEL_ONE;
+    *space = (afsk->spaceLevel * 100 + TX_LEVEL_ONE / 2) / TX_LEVEL_ONE;
+}
+#endif
+
 void afsk_init(Afsk *afsk, int _adcPin) {
     // Allocate memory for struct
     memset(afsk, 0, sizeof(*afsk));
@@ -703,19 +2516,75 @@ void afsk_init(Afsk *afsk, int _adcPin) {
     // Configure ADC pin
     afsk->adcPin = _adcPin;
 
+    // Start out with the configured preamble
+    // and tail lengths. These can be changed
+    // later, for example by a KISS host.
+    afsk->preambleTime = CONFIG_AFSK_PREAMBLE_LEN;
+    afsk->tailTime = CONFIG_AFSK_TRAILER_LEN;
+
+    // And with the configured channel access
+    afsk->persistence = CONFIG_AFSK_PERSISTENCE;
+    afsk->slotTime = CONFIG_AFSK_SLOTTIME;
+    afsk->random = 1;
+
+    #if CONFIG_AFSK_PROFILES
+    // Start out at 1200 baud
+    afsk->profile = &afskProfiles[AFSK_PROFILE_1200];
+    #endif
+
     // Initialise phase increment to that
     // of the mark frequency
-    afsk->phaseInc = MARK_INC;
-
-    // Initialize FIFO buffers
-    fifo_init(&afsk->delayFifo, (uint8_t *)afsk->delayBuf, sizeof(afsk->delayBuf));
+    afsk->phaseInc = PROFILE_MARK_INC(afsk);
+
+    // Initialize the receive FIFO buffer. The
+    // transmit buffer is empty when head and
+    // tail are both zero, which memset saw to.
+    #if CONFIG_AFSK_RX_FRAMES
+    // When receiving whole frames, all of the
+    // frame buffers start out in the pool.
+    pool_init(rxPool, NULL);
+    LIST_INIT(&afsk->rxReady);
+    #else
     fifo_init(&afsk->rxFifo, afsk->rxBuf, sizeof(afsk->rxBuf));
-    fifo_init(&afsk->txFifo, afsk->txBuf, sizeof(afsk->txBuf));
+    #endif
+
+    // Set up the demodulator settings. The delay
+    // lines are already filled with zeroes by memset.
+    #if CONFIG_AFSK_PROFILES
+    demodLoadProfile(afsk);
+    #elif CONFIG_AFSK_DEMODULATORS > 1
+    for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+        Demod *demod = &afsk->demod[i];
+        demod->delay = demodParams[i].delay;
+        demod->filterShift = demodParams[i].filterShift;
+        demod->phaseInc = demodParams[i].phaseInc;
+        demod->threshold = demodParams[i].threshold;
+        ASSERT(demod->delay < DEMOD_DELAY_LEN);
+    }
+    #endif
+
+    #if CONFIG_AFSK_AGC
+    // The input starts out levelled the way the
+    // fixed shift did, with the bias in the middle
+    afsk->agcOffset = 512 << AGC_OFFSET_FRAC;
+    afsk->agcGain = AGC_GAIN_ONE;
+    #endif
 
-    // Fill delay FIFO with zeroes
-    for (int i = 0; i<SAMPLESPERBIT / 2; i++) {
-        fifo_push(&afsk->delayFifo, 0);
+    #if CONFIG_AFSK_TX_LEVELS
+    // Both tones are sent at full level
+    // until we are told otherwise
+    afsk->markLevel = TX_LEVEL_ONE;
+    afsk->spaceLevel = TX_LEVEL_ONE;
+    afsk->txLevel = TX_LEVEL_ONE;
+    #endif
+
+    #if CONFIG_AFSK_CORRELATOR
+    // The correlators start out assuming
+    // there is no twist.
+    for (uint8_t i = 0; i < CONFIG_AFSK_DEMODULATORS; i++) {
+        afsk->demod[i].spaceGain = CORR_GAIN_ONE;
     }
+    #endif
 
     // Initialize hardware
     AFSK_ADC_INIT(_adcPin, afsk);
@@ -9,7 +9,10 @@
 #include "hardware.h"           // Hardware functions
 
 #include <cfg/compiler.h>       // Compiler info from BertOS
+#include "cfg/cfg_ax25.h"       // For the AX.25 frame buffer length
 #include <struct/fifobuf.h>     // FIFO buffer implementation from BertOS
+#include <struct/list.h>        // Lists, for keeping received frames
+#include <algo/rs.h>            // For the size of FX.25 blocks
 #include <io/kfile.h>           // The BertOS KFile interface. This is
                                 // used for letting other functions read
                                 // from or write to the modem like a
@@ -23,6 +26,38 @@
 #define BITRATE    1200            				// The actual bitrate at baseband. This is the baudrate.
 #define SAMPLESPERBIT (SAMPLERATE / BITRATE)	// How many DAC/ADC samples constitute one bit (8).
 
+#if CONFIG_AFSK_PROFILES
+// The modem profiles that can be switched between
+// at runtime, see afsk_setProfile. The constants
+// above are those of the first one, which the modem
+// starts out with.
+#define AFSK_PROFILE_1200   0               // 1200 baud, 1200/2200Hz, Bell 202 for VHF
+#define AFSK_PROFILE_300    1               // 300 baud, 1600/1800Hz, for HF
+#if CONFIG_AFSK_G3RUH
+#define AFSK_PROFILE_9600   2               // 9600 baud G3RUH, scrambled baseband
+#define AFSK_PROFILES       3               // How many profiles there are
+#else
+#define AFSK_PROFILES       2               // How many profiles there are
+#endif
+
+#define SAMPLESPERBIT_MAX (SAMPLERATE / 300)    // The most samples a bit takes in any profile
+#endif
+
+#if CONFIG_AFSK_G3RUH
+// G3RUH is sampled four times faster than the
+// audio tones, giving four samples per bit
+#define G3RUH_SAMPLERATE 38400
+#define G3RUH_BITRATE    9600
+#define G3RUH_SAMPLESPERBIT (G3RUH_SAMPLERATE / G3RUH_BITRATE)
+
+#if !CONFIG_AFSK_PROFILES
+    #error "CONFIG_AFSK_G3RUH needs CONFIG_AFSK_PROFILES"
+#endif
+#if CONFIG_AFSK_CORRELATOR
+    #error "CONFIG_AFSK_G3RUH can't be used with CONFIG_AFSK_CORRELATOR"
+#endif
+#endif
+
 // This defines an errortype for a receive-
 // buffer overrun.
 #define RX_OVERRUN BV(0)
@@ -36,8 +71,171 @@ typedef struct Hdlc
     uint8_t bitIndex;       	 // The current received bit in the current received byte
     uint8_t currentByte;    	// The byte we're currently receiving
     bool receiving;            // Whether or not where actually receiving data (or just noise ;P)
+    #if !CONFIG_AFSK_RX_FRAMES && CONFIG_AFSK_DEMODULATORS == 1
+    bool fifoFrame;                         // Bytes of an unfinished frame are in the FIFO
+    bool fifoCut;                           // And that frame was cut short by a full FIFO
+    #endif
+    #if CONFIG_AFSK_TELEMETRY
+    uint8_t bytes;                          // Bytes received since the last flag
+    uint16_t frames;                        // Frames found between two flags
+    uint16_t aborts;                        // Frames broken off by an abort
+    #endif
 } Hdlc;
 
+// The length of the delay line used for frequency
+// discrimination. Must be a power of two, and longer
+// than the longest delay any demodulator uses.
+#if CONFIG_AFSK_PROFILES
+#define DEMOD_DELAY_LEN SAMPLESPERBIT_MAX
+#else
+#define DEMOD_DELAY_LEN 8
+#endif
+
+// This struct holds one demodulator. Normally there
+// is only one, but we can run several in parallel on
+// the same samples, each with slightly different
+// settings, so that one of them is likely to get a
+// packet even if the audio is not quite ideal.
+typedef struct Demod
+{
+    #if CONFIG_AFSK_DEMODULATORS > 1 || CONFIG_AFSK_PROFILES
+    // Settings for this demodulator
+    uint8_t delay;                          // How many samples the discriminator looks back
+    #if CONFIG_AFSK_PROFILES
+    uint8_t filterGain;                     // Feedback of the lowpass filter, in 1/256ths
+    #else
+    uint8_t filterShift;                    // Feedback of the lowpass filter (y/2^shift)
+    #endif
+    int8_t phaseInc;                        // How much to nudge the phase on each transition
+    int16_t threshold;                      // Filter output level between a mark and a space
+    #endif
+
+    Hdlc hdlc;                              // We need a link control structure
+
+    int8_t delayBuf[DEMOD_DELAY_LEN];       // Delay line for frequency discrimination
+    uint8_t delayIndex;                     // Where the next sample goes in the delay line
+
+    #if CONFIG_AFSK_CORRELATOR
+    // The correlator compares the last bit worth of
+    // samples with both tones, see demodCorrelate.
+    int16_t markI, markQ;                   // Correlation with the mark tone
+    int16_t spaceI, spaceQ;                 // Correlation with the space tone
+    uint8_t markPhase, spacePhase;          // Where the tones are in the cosine table
+    int16_t markLevel, spaceLevel;          // How sure we are of each tone when we get it
+    uint16_t spaceGain;                     // Gain for the space tone, to undo twist
+    int16_t soft;                           // Last soft decision, positive for a mark
+    #else
+    int16_t iirX[2];                        // IIR Filter X cells
+    int16_t iirY[2];                        // IIR Filter Y cells
+    #endif
+
+    uint8_t sampledBits;                    // Bits sampled by the demodulator (at ADC speed)
+    int8_t currentPhase;                    // Current phase of the demodulator
+    #if CONFIG_AFSK_PLL
+    uint8_t phaseFrac;                      // Fraction of a step below the current phase
+    int16_t pllFreq;                        // How far off the transmitter's bit clock is
+    uint8_t pllLock;                        // How well the clock is locked, see PLL_LOCK_ON
+    #endif
+    uint8_t actualBits;                     // Actual found bits at correct bitrate
+    uint8_t dcd;                            // How much this looks like a signal, see DCD_ON
+    #if CONFIG_AFSK_G3RUH
+    uint32_t lfsr;                          // Descrambler state, the last 17 bits received
+    #endif
+    #if CONFIG_AFSK_SOFT_BITS
+    uint8_t bitConf;                        // How sure we are of the last bit, 0 is not at all
+    #endif
+
+    #if CONFIG_AFSK_HDLC_TABLE
+    uint8_t hdlcBits;                       // Decoded bits waiting for the HDLC parser
+    uint8_t hdlcBitCount;                   // How many bits are waiting
+    #endif
+
+    #if CONFIG_AFSK_DEMODULATORS > 1
+    // With more than one demodulator, each of them
+    // collects whole frames, so we can check them and
+    // only pass on the first good copy of each.
+    uint16_t time;                          // Sample counter, for spotting duplicates
+    uint16_t crc;                           // CRC of the frame received so far
+    #if !CONFIG_AFSK_RX_FRAMES
+    size_t frameLen;                        // Length of the frame received so far
+    uint8_t frame[CONFIG_AX25_FRAME_BUF_LEN]; // The frame itself
+    #endif
+    #endif
+
+    #if CONFIG_AFSK_RX_FRAMES
+    // Or they receive straight into a frame
+    // buffer from the pool of the modem.
+    struct AfskFrame *rxFrame;              // The frame we are receiving into
+    #endif
+} Demod;
+
+#if CONFIG_AFSK_DEMODULATORS > 1
+// How many recently passed on frames we remember, so
+// we can drop copies of them from other demodulators
+#define DEMOD_DEDUP_LEN 8
+
+typedef struct DemodSeen
+{
+    uint16_t fcs;                           // FCS of a frame we passed on
+    uint16_t time;                          // When we did it
+} DemodSeen;
+#endif
+
+#if CONFIG_AFSK_SOFT_BITS && (!CONFIG_AFSK_RX_FRAMES || CONFIG_AFSK_HDLC_TABLE)
+    #error "CONFIG_AFSK_SOFT_BITS needs CONFIG_AFSK_RX_FRAMES, and no CONFIG_AFSK_HDLC_TABLE"
+#endif
+
+#if CONFIG_AFSK_RX_FRAMES
+// When receiving whole frames, each one is kept in
+// one of these. The HDLC flags and aborts are never
+// stored, so the frame holds just the bytes that
+// were received between two flags, CRC included.
+typedef struct AfskFrame
+{
+    Node link;                              // Frames are kept in lists, see struct/pool.h
+    size_t len;                             // How many bytes the frame holds
+    uint8_t buf[CONFIG_AX25_FRAME_BUF_LEN]; // The frame itself
+
+    #if CONFIG_AFSK_SOFT_BITS
+    // The bits the demodulator was least sure of,
+    // least sure first. A bit is numbered from the
+    // start of the frame, counting from the least
+    // significant bit of each byte, like they are
+    // sent. Since the tones are NRZI coded, a tone
+    // we got wrong makes that bit and the one after
+    // it wrong.
+    uint8_t weakCount;                      // How many bits there are in the list
+    uint16_t weak[CONFIG_AFSK_SOFT_BITS];   // Where they are in the frame
+    uint8_t weakConf[CONFIG_AFSK_SOFT_BITS]; // How sure we were of them, 0 is not at all
+    #endif
+} AfskFrame;
+#endif
+
+// The type of the transmit buffer positions. They
+// count single tones, eight to a byte of the buffer.
+typedef uint16_t TxIndex;
+STATIC_ASSERT(CONFIG_AFSK_TX_BUFLEN <= UINT16_MAX / 8);
+
+#if CONFIG_AFSK_TELEMETRY && !CONFIG_AX25_STATS
+    #error "CONFIG_AFSK_TELEMETRY needs CONFIG_AX25_STATS for the frame counts"
+#endif
+
+#if CONFIG_AFSK_TELEMETRY
+// Counters for keeping an eye on how well the modem
+// receives. They count up from the last time they
+// were reset, and stop at their highest value.
+typedef struct AfskStats
+{
+    uint32_t samples;                       // Samples received
+    uint32_t busy;                          // Samples received with carrier detect on
+    uint16_t clipped;                       // Samples at either end of the ADC range
+    uint8_t peak;                           // Highest input level seen, up to 128
+    uint16_t overruns;                      // Times received data was lost, see RX_OVERRUN
+    uint16_t frames;                        // Frames the first demodulator found between flags
+    uint16_t aborts;                        // Frames it found broken off by an abort
+} AfskStats;
+#endif
+
 // This is our primary modem struct. It defines
 // all the values we need to modulate and
 // demodulate data from the physical medium.
@@ -50,39 +248,115 @@ typedef struct Afsk
     int adcPin;                             // Pin for incoming signal
 
     // General values
-    Hdlc hdlc;                              // We need a link control structure
+    uint16_t preambleTime;                  // Preamble length in milliseconds
+    uint16_t tailTime;                      // Tail length in milliseconds
     uint16_t preambleLength;                // Length of sync preamble
     uint16_t tailLength;                    // Length of transmission tail
 
+    #if CONFIG_AFSK_PROFILES
+    const struct AfskProfile *profile;      // Bitrate and tones we are using
+    #endif
+
     // Modulation values
     uint8_t sampleIndex;                    // Current sample index for outgoing bit 
-    uint8_t currentOutputByte;              // Current byte to be modulated
-    uint8_t txBit;                          // Mask of current modulated bit
-    bool bitStuff;                          // Whether bitstuffing is allowed
-
-    uint8_t bitstuffCount;                  // Counter for bit-stuffing
+    uint16_t txBits;                        // Tones left to send of the current byte
 
     uint16_t phaseAcc;                      // Phase accumulator
     uint16_t phaseInc;                      // Phase increment per sample
+    #if CONFIG_AFSK_TX_LEVELS
+    uint8_t markLevel;                      // Level of the mark tone, in 1/128ths of full scale
+    uint8_t spaceLevel;                     // Level of the space tone
+    uint8_t txLevel;                        // Level of the tone being sent right now
+    #endif
+    #if CONFIG_AFSK_G3RUH
+    uint32_t txLfsr;                        // Scrambler state, the last 17 bits sent
+    uint8_t txShape;                        // The last three scrambled bits, for shaping
+    #endif
+
+    // Encoding values. The data we transmit is
+    // bitstuffed and NRZ encoded before it goes
+    // in the transmit buffer, so the DAC ISR only
+    // has to play the tones.
+    uint8_t txOnes;                         // Counter for bit-stuffing
+    bool txTone;                            // Tone of the last encoded bit
+    bool txEscape;                          // Last written byte was an AX25_ESC
+    bool txRaw;                             // Last written byte was an AX25_RAW
 
-    FIFOBuffer txFifo;                      // FIFO for transmit data
-    uint8_t txBuf[CONFIG_AFSK_TX_BUFLEN];   // Actial data storage for said FIFO
+    uint8_t txBuf[CONFIG_AFSK_TX_BUFLEN];   // Encoded tones waiting to be sent, one per bit
+    volatile TxIndex txHead;                // Where the next encoded tone goes
+    volatile TxIndex txTail;                // Where the DAC ISR reads the next one
+    #if CONFIG_AFSK_TX_QUEUE_LEN
+    // The DAC ISR only sends frames that have been
+    // completely encoded, so it can send flags
+    // between them while the next one is written.
+    volatile TxIndex txCommit;              // Where the last complete frame ends
+    bool txStreaming;                       // Frame is too big to wait for, send as encoded
+    #endif
 
+    bool txHold;                            // Set while we should not key up yet
+    volatile bool txPending;                // Set while we wait for the channel to key up
     volatile bool sending;                  // Set when modem is sending
 
+    // Channel access values. Before keying up, we
+    // wait for the channel to be free, and then take
+    // each slot with a chance of (persistence+1)/256,
+    // so stations waiting for the same channel don't
+    // all go at once.
+    uint8_t persistence;                    // Chance of taking a free slot
+    uint8_t slotTime;                       // Slot length in 10 millisecond units
+    bool fullDuplex;                        // Key up without listening first
+    uint16_t slotCount;                     // Samples left of the current slot
+    uint16_t random;                        // Random number generator state
+
+    #if CONFIG_AFSK_AGC
+    // Input levelling values. The ADC readings have
+    // their DC offset taken out and are scaled to a
+    // steady level before the demodulators get them.
+    uint16_t agcOffset;                     // Average ADC reading, in 1/32 steps
+    uint16_t agcGain;                       // Gain, 256 is what the fixed shift gave
+    uint16_t agcPeak;                       // Recent peak output level, in 1/256 steps
+    #endif
+
     // Demodulation values
-    FIFOBuffer delayFifo;                   // Delayed FIFO for frequency discrimination
-    int8_t delayBuf[SAMPLESPERBIT / 2 + 1]; // Actual data storage for said FIFO
+    Demod demod[CONFIG_AFSK_DEMODULATORS];  // Our demodulator(s)
+
+    #if CONFIG_AFSK_DEMODULATORS > 1
+    DemodSeen seen[DEMOD_DEDUP_LEN];        // Frames we recently passed on
+    uint8_t seenIndex;                      // Where to remember the next one
+    #endif
 
+    #if CONFIG_AFSK_RX_FRAMES
+    // Received frames come from a pool of frame
+    // buffers shared with the protocol. There is
+    // only one pool, so there can only be one
+    // modem receiving whole frames.
+    List rxReady;                           // Complete frames waiting to be read
+    uint16_t rxDropped;                     // Times we had no buffer to receive into
+    #else
     FIFOBuffer rxFifo;                      // FIFO for received data
     uint8_t rxBuf[CONFIG_AFSK_RX_BUFLEN];   // Actual data storage for said FIFO
+    #endif
 
-    int16_t iirX[2];                        // IIR Filter X cells
-    int16_t iirY[2];                        // IIR Filter Y cells
+    #if CONFIG_AX25_FX25
+    // FX.25 frames are looked for by the first
+    // demodulator. Once it has seen a correlation
+    // tag, the bits after it are collected here, for
+    // the main loop to correct and unpack.
+    uint64_t fx25Corr;                      // The last 64 bits received
+    int8_t fx25Mode;                        // Code of the block we are receiving
+    volatile uint8_t fx25State;             // Looking for a tag, receiving, or done
+    uint16_t fx25Bits;                      // Bits received into the block so far
+    uint8_t fx25Buf[RS_MAX_LEN];            // The block itself
+    #if CONFIG_AFSK_DEMODULATORS > 1
+    uint16_t fx25Time;                      // When the block ended, for spotting duplicates
+    #endif
+    uint16_t fx25Frames;                    // FX.25 blocks we have unpacked a frame from
+    uint16_t fx25Fixed;                     // Bytes the Reed-Solomon code has corrected
+    #endif
 
-    uint8_t sampledBits;                    // Bits sampled by the demodulator (at ADC speed)
-    int8_t currentPhase;                    // Current phase of the demodulator
-    uint8_t actualBits;                     // Actual found bits at correct bitrate
+    #if CONFIG_AFSK_TELEMETRY
+    AfskStats stats;                        // Counters for keeping an eye on reception
+    #endif
 
     volatile int status;                    // Status of the modem, 0 means OK
 
@@ -114,7 +388,60 @@ INLINE Afsk *AFSK_CAST(KFile *fd) {
 // Declare Interrupt Service Routines
 // and initialization functions
 void afsk_adc_isr(Afsk *af, int8_t sample);
+void afsk_demod_isr(Afsk *af, uint8_t index, int8_t sample);
 uint8_t afsk_dac_isr(Afsk *af);
 void afsk_init(Afsk *af, int adc_ch);
+void afsk_txHold(Afsk *af, bool hold);
+bool afsk_dcd(Afsk *af);
+
+#if CONFIG_AFSK_PROFILES
+// Switches to another profile, one of the
+// AFSK_PROFILE_ values, once anything that is
+// being sent is done. Reception starts over.
+void afsk_setProfile(Afsk *af, uint8_t profile);
+uint8_t afsk_getProfile(Afsk *af);
+// The rate the ADC interrupt runs at in this profile
+uint16_t afsk_sampleRate(Afsk *af);
+#endif
+
+
+#if CONFIG_AFSK_TX_LEVELS
+// Sets how loud each tone is sent, in percent of
+// full scale. Both start out at 100.
+void afsk_setTxLevels(Afsk *af, uint8_t mark, uint8_t space);
+void afsk_getTxLevels(Afsk *af, uint8_t *mark, uint8_t *space);
+#endif
+
+#if CONFIG_AFSK_TELEMETRY
+// Copies the counters, or sets them all to zero
+void afsk_getStats(Afsk *af, AfskStats *stats);
+void afsk_resetStats(Afsk *af);
+#endif
+
+#if CONFIG_AFSK_AGC
+// Takes a raw 10 bit ADC reading, removes the DC
+// offset and scales it to a good level for the
+// demodulators, to pass on to afsk_adc_isr.
+int8_t afsk_agc(Afsk *af, uint16_t adc);
+// Reads the current offset, in ADC steps, and
+// gain, in 1/256ths of the fixed scaling
+void afsk_agcLevels(Afsk *af, uint16_t *offset, uint16_t *gain);
+#endif
+
+#if CONFIG_AX25_FX25
+// Corrects and unpacks a received FX.25 block, if
+// there is one, and hands the frame in it to the
+// protocol. The main loop must call this often.
+struct AX25Ctx;
+void afsk_fx25Poll(Afsk *af, struct AX25Ctx *ax25);
+#endif
+
+#if CONFIG_AFSK_RX_FRAMES
+// Getting received frames, when the modem is set
+// up to receive whole frames. Each frame must be
+// handed back when done with it.
+AfskFrame *afsk_getFrame(Afsk *af);
+void afsk_freeFrame(Afsk *af, AfskFrame *frame);
+#endif
 
 #endif
\ No newline at end of file
@@ -7,11 +7,150 @@
 #define PASSALL false
 #define AUTOREPLY false
 
+// Serial protocol options
+#define PROTOCOL_SIMPLE_SERIAL 0x01
+#define PROTOCOL_KISS 0x02
+
+#ifndef SERIAL_PROTOCOL
+#define SERIAL_PROTOCOL PROTOCOL_SIMPLE_SERIAL  // Which protocol we talk to the serial
+                                                // port with, PROTOCOL_SIMPLE_SERIAL for
+                                                // the human readable one, or PROTOCOL_KISS
+                                                // to be a KISS TNC for a host program.
+#endif
+
 // Modem options
 #define TX_MAXWAIT 2UL                      // How many milliseconds should pass with no
                                             // no incoming data before it is transmitted
+#ifndef CONFIG_AFSK_SOFT_BITS
+#define CONFIG_AFSK_SOFT_BITS 0             // Remember this many of the bits in each
+                                            // received frame that the demodulator was
+                                            // least sure of, so the protocol can try
+                                            // flipping those first when the CRC fails.
+                                            // Needs CONFIG_AFSK_RX_FRAMES, and can't be
+                                            // used with CONFIG_AFSK_HDLC_TABLE.
+#endif
+
+#ifndef CONFIG_AFSK_DEMODULATORS
+#define CONFIG_AFSK_DEMODULATORS 1          // How many demodulators to run in parallel
+                                            // on the received audio, each with slightly
+                                            // different settings. More decode more
+                                            // packets from poor audio, but each one
+                                            // costs ISR time and a frame of RAM. Two
+                                            // is about as many as the ATmega328p fits.
+#endif
+
+#ifndef CONFIG_AFSK_CORRELATOR
+#define CONFIG_AFSK_CORRELATOR 0            // Tell mark from space by correlating the
+                                            // audio with both tones, instead of with
+                                            // itself half a bit ago. Copes better with
+                                            // tone twist, at the cost of a few more
+                                            // multiplications per sample.
+#endif
+
+#ifndef CONFIG_AFSK_AGC
+#define CONFIG_AFSK_AGC 0                   // Take the DC offset out of the received
+                                            // audio and scale it to a steady level,
+                                            // using the full 10 bits of the ADC, so
+                                            // the input level doesn't need to be set
+                                            // just right with the pot.
+#endif
+
+#ifndef CONFIG_AFSK_PLL
+#define CONFIG_AFSK_PLL 0                   // Recover the bit clock with a loop that
+                                            // locks quickly on the preamble, then tracks
+                                            // slowly and follows transmitters whose
+                                            // clock is a little off. Without it, the
+                                            // phase is nudged a fixed step at a time.
+#endif
+
+#ifndef CONFIG_AFSK_PROFILES
+#define CONFIG_AFSK_PROFILES 0              // Let the modem be switched at runtime
+                                            // between 1200 baud Bell 202 for VHF and
+                                            // 300 baud with 1600/1800Hz tones for HF,
+                                            // see afsk_setProfile. Costs a bigger
+                                            // delay line and a multiplication in the
+                                            // filter of each demodulator.
+#endif
+
+#ifndef CONFIG_AFSK_G3RUH
+#define CONFIG_AFSK_G3RUH 0                 // Add a third profile for 9600 baud G3RUH
+                                            // FSK, sent and received as scrambled
+                                            // baseband through the radio's modulator
+                                            // and discriminator. The ADC interrupt
+                                            // then runs at 38.4KHz, which leaves time
+                                            // for about one demodulator. Needs
+                                            // CONFIG_AFSK_PROFILES, and can't be used
+                                            // with CONFIG_AFSK_CORRELATOR.
+#endif
+
+#ifndef CONFIG_AFSK_TELEMETRY
+#define CONFIG_AFSK_TELEMETRY 0             // Keep counters of the input level, clipped
+                                            // samples, channel activity and lost data,
+                                            // and of how many frames are found and how
+                                            // many pass the CRC check, for monitoring
+                                            // how well a station is doing.
+#endif
+
+#ifndef CONFIG_AFSK_HDLC_TABLE
+#define CONFIG_AFSK_HDLC_TABLE 0            // Deframe the received bits a byte at a
+                                            // time with a lookup table, instead of
+                                            // one bit at a time. Saves ISR cycles
+                                            // for 512 bytes of flash.
+#endif
+
+#ifndef CONFIG_AFSK_RX_FRAMES
+#define CONFIG_AFSK_RX_FRAMES 0             // If set, received data is not put in a
+                                            // byte buffer with escapes, but in this
+                                            // many frame buffers that are handed to
+                                            // the protocol whole. Each one takes a
+                                            // full frame of RAM, and there must be
+                                            // more than there are demodulators.
+#endif
+
+#if CONFIG_AFSK_DEMODULATORS > 1
+#define CONFIG_AFSK_RX_BUFLEN 400           // With several demodulators, whole frames are
+                                            // put in the receive buffer at once, so it
+                                            // must be large enough to hold one.
+#else
 #define CONFIG_AFSK_RX_BUFLEN 64            // The size of the modems receive buffer
-#define CONFIG_AFSK_TX_BUFLEN 64            // The size of the modems transmit buffer
+#endif
+#ifndef CONFIG_AFSK_TX_QUEUE_LEN
+#define CONFIG_AFSK_TX_QUEUE_LEN 0          // If set, the transmit buffer holds this many
+                                            // bytes of encoded frames, and frames are
+                                            // only sent once completely written. Sending
+                                            // then doesn't wait for the DAC while there
+                                            // is room, and the frames in the buffer go
+                                            // out back to back after a single preamble.
+#endif
+#ifndef CONFIG_AFSK_TX_BUFLEN
+#if CONFIG_AFSK_TX_QUEUE_LEN
+#define CONFIG_AFSK_TX_BUFLEN CONFIG_AFSK_TX_QUEUE_LEN
+#elif SERIAL_PROTOCOL == PROTOCOL_KISS
+#define CONFIG_AFSK_TX_BUFLEN 400           // A KISS TNC only keys up when it has the
+                                            // whole frame from the host, so it needs
+                                            // room for a full frame and its flags.
+                                            // 330 bytes are at most 3168 tones with
+                                            // bit stuffing, which fit in 400 bytes.
+#else
+#define CONFIG_AFSK_TX_BUFLEN 64            // The size of the modems transmit buffer,
+                                            // in bytes of eight encoded tones each
+#endif
+#endif
+#ifndef CONFIG_AFSK_TX_LEVELS
+#define CONFIG_AFSK_TX_LEVELS 0             // Let the mark and space tones be sent at
+                                            // different levels, set over serial, to
+                                            // make up for radios that de-emphasise
+                                            // the 2200Hz tone. Costs a multiplication
+                                            // per sample in the DAC interrupt.
+#endif
+
+#ifndef CONFIG_AFSK_PWM_DAC
+#define CONFIG_AFSK_PWM_DAC 0               // Send the audio out as 8-bit PWM from
+                                            // Timer2 on PB3 (pin 11), instead of on
+                                            // the 4-bit resistor DAC on pins 4 to 7.
+                                            // Much cleaner tones, but the pin needs
+                                            // an RC lowpass filter to the radio.
+#endif
 #define CONFIG_AFSK_DAC_SAMPLERATE 9600     // The samplerate of the DAC. Note that
                                             // changing it here will not change the
                                             // actual sample rate. It is defined here
@@ -22,4 +161,16 @@
 #define CONFIG_AFSK_PREAMBLE_LEN 350UL      // The length of the packet preamble in milliseconds
 #define CONFIG_AFSK_TRAILER_LEN 50UL        // The length of the packet tail in milliseconds
 
+#define CONFIG_AFSK_PERSISTENCE 63          // When the channel is free, the chance out of 256
+                                            // that we key up in a slot, less one. With 63, we
+                                            // take one slot in four.
+#define CONFIG_AFSK_SLOTTIME 10             // The length of a slot, in 10 millisecond units
+
+// Instrumentation options
+#ifndef CONFIG_AFSK_ISR_STATS
+#define CONFIG_AFSK_ISR_STATS 0             // Measure how many CPU cycles the modem
+                                            // interrupt uses. Costs a little time
+                                            // in the ISR, so keep it off normally.
+#endif
+
 #endif
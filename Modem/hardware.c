@@ -13,6 +13,11 @@
 // A reference to our modem "object"
 static Afsk *modem;
 
+#if CONFIG_AFSK_ISR_STATS
+// Cycle counts for the ADC interrupt
+IsrStats hw_isrStats;
+#endif
+
 //////////////////////////////////////////////////////
 // And now for the actual hardware functions        //
 //////////////////////////////////////////////////////
@@ -102,6 +107,43 @@ void hw_afsk_adcInit(int ch, Afsk *_modem)
 }
 
 
+// Changes the sampling rate, for the 9600 baud
+// profile. It is the same calculation as above, and
+// since the timer counts up to ICR1, we restart it
+// so it can't have already gone past the new TOP.
+void hw_afsk_adcRate(uint16_t rate)
+{
+    ATOMIC(
+        ICR1 = (((CPU_FREQ+FREQUENCY_CORRECTION)) / rate) - 1;
+        TCNT1 = 0;
+    );
+}
+
+#if CONFIG_AFSK_PWM_DAC
+// Sets up Timer2 to output the audio as PWM on
+// OC2A, which is PB3. The timer counts from 0 to
+// 255 at the full 16MHz, and the pin is high until
+// the count reaches OCR2A, so the average voltage on
+// the pin follows the 8-bit sample we put in OCR2A.
+// That happens at 62.5KHz, far above the audio, so
+// a simple RC filter leaves only the audio.
+//
+// The bits set are:
+// COM2A1: Clear OC2A on compare match, set it at BOTTOM
+// WGM21 and WGM20: Fast PWM, with 0xFF as TOP
+// CS20: No prescaler
+//
+// Timer0 is the BertOS system timer, so we can't
+// use that one.
+void hw_afsk_pwmInit(void)
+{
+    DDRB |= BV(3);
+    OCR2A = 128;
+    TCCR2A = BV(COM2A1) | BV(WGM21) | BV(WGM20);
+    TCCR2B = BV(CS20);
+}
+#endif
+
 // This declares the Interrupt Service routine that will
 // get called everytime the ADC finishes taking a sample.
 // What actually happens here is that we take a piece of
@@ -114,6 +156,14 @@ void hw_afsk_adcInit(int ch, Afsk *_modem)
 bool hw_ptt_on;
 bool hw_afsk_dac_isr;
 DECLARE_ISR(ADC_vect) {
+    #if CONFIG_AFSK_ISR_STATS
+    // If we are measuring the ISR, we note down the
+    // Timer1 count right away, and again around each
+    // of the modem routines.
+    uint16_t isrStart = HW_CYCLES();
+    uint16_t start = isrStart;
+    #endif
+
     TIFR1 = BV(ICF1);
 
     // Call the routine for analysing the captured sample
@@ -128,7 +178,18 @@ DECLARE_ISR(ADC_vect) {
     // can't read negative voltages. By doing this simple
     // math, we bring it back to an AC representation
     // we can do further calculations on.
+    //
+    // With the AGC, the modem gets the full reading
+    // instead, and finds the bias and level itself.
+    #if CONFIG_AFSK_AGC
+    afsk_adc_isr(modem, afsk_agc(modem, ADC));
+    #else
     afsk_adc_isr(modem, ((int16_t)((ADC) >> 2) - 128));
+    #endif
+
+    #if CONFIG_AFSK_ISR_STATS
+    hw_isrStat_add(&hw_isrStats.adc, HW_CYCLES_SINCE(start));
+    #endif
 
     // We also need to check if we're supposed to spit
     // out some modulated data to the DAC.
@@ -143,19 +204,47 @@ DECLARE_ISR(ADC_vect) {
         // we also need to trigger another pin controlled
         // by the PORTD register. This is the PTT pin
         // which tells the radio to open it transmitter.
+        #if CONFIG_AFSK_ISR_STATS
+        start = HW_CYCLES();
+        #endif
+        #if CONFIG_AFSK_PWM_DAC
+        // With the PWM DAC, the whole 8-bit sample
+        // goes to Timer2, and on PORTD we only need
+        // to hold the PTT pin high
+        OCR2A = afsk_dac_isr(modem);
+        PORTD |= BV(3);
+        #else
         PORTD = (afsk_dac_isr(modem) & 0xF0) | BV(3); 
+        #endif
+        #if CONFIG_AFSK_ISR_STATS
+        hw_isrStat_add(&hw_isrStats.dac, HW_CYCLES_SINCE(start));
+        #endif
     } else {
         // If we're not supposed to transmit anything, we
         // keep quiet by continously sending 128, which
         // when converted to an AC waveform by the DAC,
         // equates to a steady, unchanging 0 volts.
+        #if CONFIG_AFSK_PWM_DAC
+        // The PWM DAC idles at the middle, and the
+        // PTT pin follows hw_ptt_on, just like below
+        OCR2A = 128;
+        if (hw_ptt_on) {
+            PORTD |= BV(3);
+        } else {
+            PORTD &= ~BV(3);
+        }
+        #else
         if (hw_ptt_on) {
             PORTD = 136;
         } else {
             PORTD = 128;
         }
+        #endif
     }
-        
+
+    #if CONFIG_AFSK_ISR_STATS
+    hw_isrStat_add(&hw_isrStats.total, HW_CYCLES_SINCE(isrStart));
+    #endif
 }
 
 
@@ -5,9 +5,17 @@
 #ifndef FSK_MODEM_HW
 #define FSK_MODEM_HW
 
+#include "config.h"          // Various configuration values
 #include "cfg/cfg_arch.h"    // Architecture configuration
 
-#include <avr/io.h>          // AVR IO functions from BertOS
+#include <cfg/os.h>          // OS detection from BertOS
+#include <cpu/irq.h>         // Interrupt functions from BertOS
+
+#include <string.h>          // For memset
+
+#if !OS_HOSTED
+    #include <avr/io.h>      // AVR IO functions from BertOS
+#endif
 
 //////////////////////////////////////////////////////
 // Definitions and some useful macros               //
@@ -19,6 +27,96 @@ struct Afsk;
 // Function declarations
 void hw_afsk_adcInit(int ch, struct Afsk *_ctx);
 void hw_afsk_dacInit(int ch, struct Afsk *_ctx);
+void hw_afsk_adcRate(uint16_t rate);
+void hw_afsk_pwmInit(void);
+
+// Cycle statistics for one piece of the ADC interrupt.
+// To keep the math cheap in the ISR, the sum and count
+// are both halved when the count is about to overflow,
+// which keeps the average correct.
+typedef struct IsrStat
+{
+    uint16_t min;       // Fewest cycles seen
+    uint16_t max;       // Most cycles seen
+    uint32_t sum;       // Sum of all cycles counted
+    uint16_t count;     // How many times we counted
+} IsrStat;
+
+typedef struct IsrStats
+{
+    IsrStat adc;        // Time spent in afsk_adc_isr()
+    IsrStat dac;        // Time spent in afsk_dac_isr()
+    IsrStat total;      // Time spent in the whole interrupt
+} IsrStats;
+
+#if CONFIG_AFSK_ISR_STATS
+extern IsrStats hw_isrStats;
+
+// Adds a measurement to a statistic. Only call this
+// from the interrupt itself.
+INLINE void hw_isrStat_add(IsrStat *stat, uint16_t cycles) {
+    if (stat->count == 0xFFFF) {
+        stat->sum >>= 1;
+        stat->count >>= 1;
+    }
+    if (stat->count == 0 || cycles < stat->min) stat->min = cycles;
+    if (cycles > stat->max) stat->max = cycles;
+    stat->sum += cycles;
+    stat->count++;
+}
+
+// Takes a consistent copy of the statistics
+INLINE void hw_isrStats_get(IsrStats *copy) {
+    ATOMIC(*copy = hw_isrStats);
+}
+
+// Starts counting over
+INLINE void hw_isrStats_reset(void) {
+    ATOMIC(memset(&hw_isrStats, 0, sizeof(hw_isrStats)));
+}
+#endif
+
+#if OS_HOSTED
+
+// When we are built for a PC (see the Modem/host
+// directory), there are no pins, LEDs or timers to
+// configure. The host code stands in for the ADC
+// interrupt instead, so all we need to do here is
+// keep track of the same flags the AVR code uses.
+#define LED_TX_INIT() do { } while (0)
+#define LED_TX_ON()   do { } while (0)
+#define LED_TX_OFF()  do { } while (0)
+
+#define LED_RX_INIT() do { } while (0)
+#define LED_RX_ON()   do { } while (0)
+#define LED_RX_OFF()  do { } while (0)
+
+#define AFSK_ADC_INIT(ch, ctx) hw_afsk_adcInit(ch, ctx)
+#define AFSK_ADC_RATE(rate)    hw_afsk_adcRate(rate)
+#define AFSK_DAC_INIT()   do { } while (0)
+
+#define AFSK_DAC_IRQ_START()   do { extern bool hw_afsk_dac_isr; hw_afsk_dac_isr = true; } while (0)
+#define AFSK_DAC_IRQ_STOP()    do { extern bool hw_afsk_dac_isr; hw_afsk_dac_isr = false; } while (0)
+
+#define AFSK_HW_PTT_ON()     do { extern bool hw_ptt_on; hw_ptt_on = true; } while (0)
+#define AFSK_HW_PTT_OFF()    do { extern bool hw_ptt_on; hw_ptt_on = false; } while (0)
+
+// The host build may run several demodulators in
+// different threads, so passing on frames from them
+// needs a lock.
+void hw_host_lock(void);
+void hw_host_unlock(void);
+#define AFSK_DEMOD_LOCK()    hw_host_lock()
+#define AFSK_DEMOD_UNLOCK()  hw_host_unlock()
+
+// The host has no Timer1 to count cycles with, so
+// "cycles" are whatever hw_host_cycles() can offer,
+// which is the CPU timestamp counter on x86.
+uint16_t hw_host_cycles(void);
+#define HW_CYCLES()                  hw_host_cycles()
+#define HW_CYCLES_SINCE(start)       ((uint16_t)(HW_CYCLES() - (start)))
+
+#else
 
 // Here's some macros for controlling the RX/TX LEDs
 // THE _INIT() functions writes to the DDRB register
@@ -38,12 +136,23 @@ void hw_afsk_dacInit(int ch, struct Afsk *_ctx);
 // in "hardware.c"
 #define AFSK_ADC_INIT(ch, ctx) hw_afsk_adcInit(ch, ctx)
 
+// Changes how often the ADC takes a sample, and so
+// how often the modem interrupt runs
+#define AFSK_ADC_RATE(rate) hw_afsk_adcRate(rate)
+
 // Initialization of the DAC pins. The DDRD register
 // configures pins 0 through 7 for input or output.
 // DDR stands for Data Direction Register. By setting
 // it to 0xF8 we set 11111000, which means the pins
 // 3, 4, 5, 6 and 7 will be set to output.
+//
+// With the PWM DAC, the audio comes out of Timer2
+// instead, so only the PTT pin is needed on PORTD.
+#if CONFIG_AFSK_PWM_DAC
+#define AFSK_DAC_INIT()   do { DDRD |= BV(3); hw_afsk_pwmInit(); } while (0)
+#else
 #define AFSK_DAC_INIT()   do { DDRD |= 0xF8; } while (0)
+#endif
 
 // These two macros start and stop the DAC routine
 // being called in our timer interrupt. For starting
@@ -56,4 +165,21 @@ void hw_afsk_dacInit(int ch, struct Afsk *_ctx);
 #define AFSK_HW_PTT_ON()     do { extern bool hw_ptt_on; hw_ptt_on = true; } while (0)
 #define AFSK_HW_PTT_OFF()    do { extern bool hw_ptt_on; hw_ptt_on = false; } while (0)
 
+// All demodulators run in the same interrupt, so
+// there is nothing to lock.
+#define AFSK_DEMOD_LOCK()    do { } while (0)
+#define AFSK_DEMOD_UNLOCK()  do { } while (0)
+
+// Timer1 runs without a prescaler, so it counts CPU
+// cycles directly. It wraps around to zero once it
+// reaches ICR1 though, so we need to account for that
+// when we measure something that spans the wrap.
+#define HW_CYCLES()                  TCNT1
+#define HW_CYCLES_SINCE(start)       ({ \
+        uint16_t __now = TCNT1; \
+        (uint16_t)((__now >= (start)) ? (__now - (start)) : (__now + ICR1 + 1 - (start))); \
+    })
+
+#endif
+
 #endif
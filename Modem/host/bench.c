@@ -0,0 +1,711 @@
+//////////////////////////////////////////////////////
+// First things first, all the includes we need     //
+//////////////////////////////////////////////////////
+
+#include "hw_host.h"        // Host stand-in for the ADC interrupt
+
+// We include the modem itself, rather than linking
+// with it, so we can reach the HDLC parser and the
+// keying functions, which are all static.
+#include "afsk.c"
+
+#include <net/ax25.h>       // AX.25 protocol from BertOS
+#include <algo/crc_ccitt.h> // CRC-CCITT from BertOS
+#include <net/fx25.h>       // FX.25 from BertOS
+
+#include <stdio.h>          // Standard input/output
+#include <stdlib.h>         // malloc, atoi and friends
+#include <string.h>         // String operations
+#include <math.h>           // For measuring the tones
+#include <time.h>           // For timing everything
+
+//////////////////////////////////////////////////////
+// A few definitions                                //
+//////////////////////////////////////////////////////
+
+// This program measures how fast each stage of the
+// modem runs on the host, and how fast they all run
+// together, so we can see when a change makes any of
+// them slower. It prints one line per measurement,
+// with the name, the value and the unit separated by
+// tabs, so the output is easy to keep and compare.
+// Where two ways of doing the same thing are built
+// in, it also checks that they agree, and exits with
+// 1 if they don't.
+
+static Afsk afsk;           // Declare a AFSK modem struct
+static AX25Ctx ax25;        // Declare a protocol struct
+
+#define FRAMES 100          // How many frames we send and receive
+#define CRC_LEN 330         // Length of the buffer we run the CRC over
+
+static double minTime = 0.5;        // Run each measurement at least this long
+static unsigned long frames = 0;    // Frames the protocol has decoded
+
+static uint8_t *audio;      // The modulated frames
+static size_t audioLen;
+
+static uint8_t *rxBytes;    // The frames as the modem gives them to the protocol
+
+static uint8_t *hdlcBits;   // The frames as bits from the demodulator
+static size_t hdlcLen;
+
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double value, const char *unit) {
+    printf("%s\t%.0f\t%s\n", name, value, unit);
+}
+
+static void message_callback(struct AX25Msg *msg) {
+    (void)msg;
+    frames++;
+}
+
+// Throws away whatever the modem has received, for
+// when we only want to measure the modem itself.
+static void drain(void) {
+    #if CONFIG_AFSK_RX_FRAMES
+    AfskFrame *frame;
+    while ((frame = afsk_getFrame(&afsk))) {
+        afsk_freeFrame(&afsk, frame);
+    }
+    #else
+    fifo_flush(&afsk.rxFifo);
+    #endif
+}
+
+// Makes up the payload of frame number i. The
+// lengths and contents vary, and include bytes
+// that need escaping and stuffing.
+static size_t payload(unsigned i, uint8_t *buf) {
+    size_t len = 20 + (i * 37) % 200;
+    for (size_t j = 0; j < len; j++) {
+        buf[j] = (uint8_t)(i * 131 + j * 17 + (j >> 3));
+    }
+    return len;
+}
+
+//////////////////////////////////////////////////////
+// Transmitting                                     //
+//////////////////////////////////////////////////////
+
+// The transmit buffer on the AVR is emptied by the
+// DAC interrupt. Here, the protocol writes to this
+// file instead, which plays the DAC ISR whenever the
+// buffer is full, and keeps the time it takes.
+static double dacTime;
+static unsigned long dacSamples;
+
+static void runDac(bool all) {
+    double start = 0;
+    for (;;) {
+        // We have the channel to ourselves
+        if (afsk.txPending) afsk_txKeyNow(&afsk);
+        // Unless we are to send everything, we stop
+        // when the buffer is half empty, so we don't
+        // spend more time looking at the clock than
+        // running the ISR.
+        TxIndex used = TX_USED(afsk.txHead, afsk.txTail);
+        if (!afsk.sending || (!all && used < TX_TONES / 2)) break;
+        if (!start) start = now();
+        audio[audioLen++] = afsk_dac_isr(&afsk);
+        dacSamples++;
+    }
+    if (start) dacTime += now() - start;
+}
+
+static size_t txWrite(struct KFile *fd, const void *buf, size_t size) {
+    (void)fd;
+    const uint8_t *p = (const uint8_t *)buf;
+    for (size_t i = 0; i < size; i++) {
+        if (TX_USED(afsk.txHead, afsk.txTail) + TX_BYTE_TONES >= TX_TONES) runDac(false);
+        kfile_putc(p[i], &afsk.fd);
+    }
+    return size;
+}
+
+static KFile txFile;
+
+// Sends all our frames, and keeps the audio
+static void transmit(void) {
+    AX25Call path[] = {AX25_CALL("APZMDM", 0), AX25_CALL("NOCALL", 0)};
+    uint8_t buf[CONFIG_AX25_FRAME_BUF_LEN];
+
+    afsk_init(&afsk, 0);
+    kfile_init(&txFile);
+    txFile.write = txWrite;
+    ax25_init(&ax25, &txFile, NULL);
+    audioLen = 0;
+    for (unsigned i = 0; i < FRAMES; i++) {
+        size_t len = payload(i, buf);
+        ax25_sendVia(&ax25, path, countof(path), buf, len);
+        runDac(true);
+    }
+}
+
+static void benchTx(void) {
+    double start = now(), elapsed;
+    unsigned long runs = 0;
+    dacTime = 0;
+    dacSamples = 0;
+    do {
+        transmit();
+        runs++;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    report("tx_frames_per_s", runs * FRAMES / elapsed, "frames/s");
+    report("tx_samples_per_s", dacSamples / elapsed, "samples/s");
+    report("modulator_samples_per_s", dacSamples / dacTime, "samples/s");
+}
+
+//////////////////////////////////////////////////////
+// DAC                                              //
+//////////////////////////////////////////////////////
+
+// How clean the tones out of the DAC are. We play a
+// tone the way the DAC ISR does, for as many samples
+// as it takes to come back to the same phase, keeping
+// only the bits the DAC has, and measure everything
+// that isn't the tone itself against the tone. That
+// is the harmonics and the rounding noise together,
+// THD+N, in dB. The resistor DAC gets the top four
+// bits of each sample, and the PWM DAC all eight.
+#define THD_LEN (SIN_LEN * 16)
+
+static double toneThd(uint16_t inc, uint8_t mask) {
+    double sum = 0, sumSq = 0, re = 0, im = 0;
+    uint16_t phase = 0;
+    for (unsigned i = 0; i < THD_LEN; i++) {
+        phase = (phase + inc) % SIN_LEN;
+        double sample = sinSample(phase) & mask;
+        double w = 2 * M_PI * i * inc / SIN_LEN;
+        sum += sample;
+        sumSq += sample * sample;
+        re += sample * cos(w);
+        im += sample * sin(w);
+    }
+
+    double mean = sum / THD_LEN;
+    double total = sumSq / THD_LEN - mean * mean;
+    double tone = 2 * (re * re + im * im) / ((double)THD_LEN * THD_LEN);
+    return 10 * log10((total - tone) / tone);
+}
+
+static void benchDac(void) {
+    report("dac_4bit_mark_thd", toneThd(MARK_INC, 0xF0), "dB");
+    report("dac_4bit_space_thd", toneThd(SPACE_INC, 0xF0), "dB");
+    report("dac_8bit_mark_thd", toneThd(MARK_INC, 0xFF), "dB");
+    report("dac_8bit_space_thd", toneThd(SPACE_INC, 0xFF), "dB");
+}
+
+//////////////////////////////////////////////////////
+// Receiving                                        //
+//////////////////////////////////////////////////////
+
+// The demodulator on its own, with whatever it
+// receives thrown away
+static void benchDemod(void) {
+    double start = now(), elapsed;
+    unsigned long samples = 0;
+    do {
+        afsk_init(&afsk, 0);
+        for (size_t i = 0; i < audioLen; i++) {
+            afsk_adc_isr(&afsk, (int16_t)audio[i] - 128);
+            if (i % (SAMPLESPERBIT * 8) == 0) drain();
+        }
+        samples += audioLen;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    report("demodulator_samples_per_s", samples / elapsed, "samples/s");
+}
+
+#if CONFIG_AFSK_AGC
+// The input levelling on its own, with the samples
+// shifted up to 10 bits like the ADC reads them
+static void benchAgc(void) {
+    double start = now(), elapsed;
+    unsigned long samples = 0;
+    volatile int8_t result;
+    do {
+        afsk_init(&afsk, 0);
+        for (size_t i = 0; i < audioLen; i++) {
+            result = afsk_agc(&afsk, (uint16_t)audio[i] << 2);
+        }
+        samples += audioLen;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    (void)result;
+    report("agc_samples_per_s", samples / elapsed, "samples/s");
+}
+#endif
+
+// The HDLC parser on its own. We record the bits the
+// demodulator hands it, and then feed them to it again
+// the same way demodSample does.
+static void recordBits(void) {
+    hdlcBits = malloc(audioLen / SAMPLESPERBIT + 16);
+    hdlcLen = 0;
+
+    afsk_init(&afsk, 0);
+    Demod *demod = &afsk.demod[0];
+    for (size_t i = 0; i < audioLen; i++) {
+        int8_t phase = demod->currentPhase;
+        demodSample(&afsk, demod, (int16_t)audio[i] - 128);
+        // A bit was sampled if the phase wrapped
+        if (demod->currentPhase < phase) {
+            hdlcBits[hdlcLen++] = !TRANSITION_FOUND(demod->actualBits);
+        }
+        if (i % (SAMPLESPERBIT * 8) == 0) drain();
+    }
+}
+
+static void benchHdlc(void) {
+    double start = now(), elapsed;
+    unsigned long bits = 0;
+    do {
+        afsk_init(&afsk, 0);
+        Demod *demod = &afsk.demod[0];
+        for (size_t i = 0; i < hdlcLen; i++) {
+            bool bit = hdlcBits[i];
+            #if CONFIG_AFSK_HDLC_TABLE
+            demod->hdlcBits = (demod->hdlcBits << 1) | bit;
+            if (++demod->hdlcBitCount == 8) {
+                demod->hdlcBitCount = 0;
+                hdlcParseByte(&afsk, demod, demod->hdlcBits);
+            }
+            #else
+            hdlcFound(&afsk, demod, hdlcParse(&demod->hdlc, bit));
+            #endif
+            if (i % 8 == 0) drain();
+        }
+        bits += hdlcLen;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    report("hdlc_bits_per_s", bits / elapsed, "bits/s");
+}
+
+#if CONFIG_AFSK_HDLC_TABLE
+// The table driven HDLC parser must find exactly what
+// the bitwise one finds, since it hands anything out
+// of the ordinary to hdlcParse. We check that by
+// running both over the same bits and comparing what
+// comes out of the modem. The bits are the recorded
+// frames, the same with bits flipped here and there,
+// and noise with long runs of ones, so flags, aborts
+// and stuffed bits turn up in all sorts of places.
+
+// Takes what the modem has received so far and adds
+// it to out, frames as their length and bytes.
+static size_t collect(uint8_t *out, size_t len) {
+    #if CONFIG_AFSK_RX_FRAMES
+    AfskFrame *frame;
+    while ((frame = afsk_getFrame(&afsk))) {
+        out[len++] = frame->len & 0xFF;
+        out[len++] = frame->len >> 8;
+        memcpy(out + len, frame->buf, frame->len);
+        len += frame->len;
+        afsk_freeFrame(&afsk, frame);
+    }
+    #else
+    while (!fifo_isempty(&afsk.rxFifo)) {
+        out[len++] = fifo_pop(&afsk.rxFifo);
+    }
+    #endif
+    return len;
+}
+
+// Parses count bits, which must be a whole number of
+// bytes, one way or the other
+static size_t parseBits(const uint8_t *bits, size_t count, bool table, uint8_t *out) {
+    size_t len = 0;
+    afsk_init(&afsk, 0);
+    Demod *demod = &afsk.demod[0];
+    for (size_t i = 0; i < count; i++) {
+        if (table) {
+            demod->hdlcBits = (demod->hdlcBits << 1) | bits[i];
+            if (++demod->hdlcBitCount == 8) {
+                demod->hdlcBitCount = 0;
+                hdlcParseByte(&afsk, demod, demod->hdlcBits);
+            }
+        } else {
+            hdlcFound(&afsk, demod, hdlcParse(&demod->hdlc, bits[i]));
+        }
+        if (i % 8 == 7) len = collect(out, len);
+    }
+    return len;
+}
+
+static bool checkHdlcStream(const char *name, const uint8_t *bits, size_t count) {
+    count &= ~(size_t)7;
+    uint8_t *bitwise = malloc(count * 2 + 16);
+    uint8_t *table = malloc(count * 2 + 16);
+    size_t bitwiseLen = parseBits(bits, count, false, bitwise);
+    size_t tableLen = parseBits(bits, count, true, table);
+
+    size_t i = 0;
+    while (i < bitwiseLen && i < tableLen && bitwise[i] == table[i]) i++;
+    bool same = (i == bitwiseLen && i == tableLen);
+    if (!same) {
+        fprintf(stderr, "HDLC table parser differs on %s: %zu and %zu bytes out, first difference at %zu\n",
+            name, bitwiseLen, tableLen, i);
+    }
+
+    free(bitwise);
+    free(table);
+    return same;
+}
+
+static bool checkHdlcTable(void) {
+    uint8_t *bits = malloc(hdlcLen);
+    uint32_t random = 1;
+    bool ok = checkHdlcStream("recorded frames", hdlcBits, hdlcLen);
+
+    for (size_t i = 0; i < hdlcLen; i++) {
+        random = random * 1103515245 + 12345;
+        bits[i] = hdlcBits[i] ^ ((random >> 16) % 97 == 0);
+    }
+    ok &= checkHdlcStream("frames with flipped bits", bits, hdlcLen);
+
+    for (size_t i = 0; i < hdlcLen; i++) {
+        random = random * 1103515245 + 12345;
+        bits[i] = (random >> 16) % 4 != 0;
+    }
+    ok &= checkHdlcStream("noise", bits, hdlcLen);
+
+    free(bits);
+    return ok;
+}
+#endif
+
+// The protocol on its own. We record what the modem
+// gives it, and then let it have all of that again
+// from memory.
+#if CONFIG_AFSK_RX_FRAMES
+static AfskFrame rxFrames[FRAMES];
+static size_t rxCount;
+
+static void recordBytes(void) {
+    rxCount = 0;
+    afsk_init(&afsk, 0);
+    for (size_t i = 0; i < audioLen; i++) {
+        afsk_adc_isr(&afsk, (int16_t)audio[i] - 128);
+        AfskFrame *frame;
+        while ((frame = afsk_getFrame(&afsk))) {
+            if (rxCount < FRAMES) rxFrames[rxCount++] = *frame;
+            afsk_freeFrame(&afsk, frame);
+        }
+    }
+}
+
+static void benchProtocol(void) {
+    double start = now(), elapsed;
+    unsigned long runs = 0;
+    frames = 0;
+    do {
+        ax25_init(&ax25, &afsk.fd, message_callback);
+        for (size_t i = 0; i < rxCount; i++) {
+            ax25_receive(&ax25, rxFrames[i].buf, rxFrames[i].len);
+        }
+        runs++;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    if (frames != runs * FRAMES)
+        fprintf(stderr, "Protocol decoded %lu of %lu frames\n", frames, runs * FRAMES);
+    report("ax25_receive_frames_per_s", frames / elapsed, "frames/s");
+}
+#else
+static size_t rxLen;
+static size_t rxPos;
+
+static size_t rxRead(struct KFile *fd, void *buf, size_t size) {
+    (void)fd;
+    size = MIN(size, rxLen - rxPos);
+    memcpy(buf, rxBytes + rxPos, size);
+    rxPos += size;
+    return size;
+}
+
+static KFile rxFile;
+
+static void recordBytes(void) {
+    rxBytes = malloc(audioLen / SAMPLESPERBIT + 16);
+    rxLen = 0;
+
+    afsk_init(&afsk, 0);
+    for (size_t i = 0; i < audioLen; i++) {
+        afsk_adc_isr(&afsk, (int16_t)audio[i] - 128);
+        while (!fifo_isempty(&afsk.rxFifo)) {
+            rxBytes[rxLen++] = fifo_pop(&afsk.rxFifo);
+        }
+    }
+}
+
+static void benchProtocol(void) {
+    double start = now(), elapsed;
+    unsigned long runs = 0;
+    frames = 0;
+    do {
+        rxPos = 0;
+        kfile_init(&rxFile);
+        rxFile.read = rxRead;
+        ax25_init(&ax25, &rxFile, message_callback);
+        ax25_poll(&ax25);
+        runs++;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    if (frames != runs * FRAMES)
+        fprintf(stderr, "Protocol decoded %lu of %lu frames\n", frames, runs * FRAMES);
+    report("ax25_poll_frames_per_s", frames / elapsed, "frames/s");
+}
+#endif
+
+// Everything from the audio to the protocol, like
+// the main loop does it
+static void poll(void) {
+    #if CONFIG_AFSK_RX_FRAMES
+    AfskFrame *frame;
+    while ((frame = afsk_getFrame(&afsk))) {
+        #if CONFIG_AFSK_SOFT_BITS
+        ax25_receiveSoft(&ax25, frame->buf, frame->len, frame->weak, frame->weakCount);
+        #else
+        ax25_receive(&ax25, frame->buf, frame->len);
+        #endif
+        afsk_freeFrame(&afsk, frame);
+    }
+    #else
+    ax25_poll(&ax25);
+    #endif
+    #if CONFIG_AX25_FX25
+    afsk_fx25Poll(&afsk, &ax25);
+    #endif
+}
+
+static void benchRx(void) {
+    double start = now(), elapsed;
+    unsigned long samples = 0, runs = 0;
+    frames = 0;
+    do {
+        afsk_init(&afsk, 0);
+        ax25_init(&ax25, &afsk.fd, message_callback);
+        for (size_t i = 0; i < audioLen; i++) {
+            afsk_adc_isr(&afsk, (int16_t)audio[i] - 128);
+            if (i % (SAMPLESPERBIT * 8) == 0) poll();
+        }
+        poll();
+        samples += audioLen;
+        runs++;
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    if (frames != runs * FRAMES)
+        fprintf(stderr, "Receiver decoded %lu of %lu frames\n", frames, runs * FRAMES);
+    report("rx_samples_per_s", samples / elapsed, "samples/s");
+    report("rx_frames_per_s", frames / elapsed, "frames/s");
+}
+
+//////////////////////////////////////////////////////
+// CRC                                              //
+//////////////////////////////////////////////////////
+
+// The CRC over a whole frame, either a byte at a
+// time like the receiver does it as the bytes come
+// in, or with crc_ccitt() like ax25_receive() does
+// for a whole frame. How crc_ccitt() goes about it
+// is picked with CONFIG_CRC_CCITT_SLICE, so build
+// with each setting to compare them.
+static void benchCrc(bool bulk) {
+    uint8_t buf[CRC_LEN];
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (uint8_t)(i * 7);
+
+    double start = now(), elapsed;
+    unsigned long bytes = 0;
+    volatile uint16_t result;
+    do {
+        for (int r = 0; r < 1000; r++) {
+            uint16_t crc = CRC_CCITT_INIT_VAL;
+            if (bulk) {
+                crc = crc_ccitt(crc, buf, sizeof(buf));
+            } else {
+                for (size_t i = 0; i < sizeof(buf); i++)
+                    crc = updcrc_ccitt(buf[i], crc);
+            }
+            result = crc;
+        }
+        bytes += 1000 * sizeof(buf);
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+    (void)result;
+
+    report(bulk ? "crc_ccitt_bytes_per_s" : "updcrc_ccitt_bytes_per_s", bytes / elapsed, "bytes/s");
+}
+
+// crc_ccitt() must give the same CRC as running
+// updcrc_ccitt() over the buffer, and as working it
+// out a bit at a time, whichever slicing it is built
+// with. We check that on random buffers of random
+// lengths, starting at every alignment, since the
+// slices don't care where the buffer starts.
+#define CRC_CHECKS 20000
+
+static uint16_t crcBitwise(uint16_t crc, const uint8_t *buf, size_t len) {
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x8408 : crc >> 1;
+        }
+    }
+    return crc;
+}
+
+static bool checkCrc(void) {
+    uint8_t buf[CRC_LEN + 8];
+    uint32_t random = 1;
+    unsigned long bad = 0;
+
+    for (unsigned n = 0; n < CRC_CHECKS; n++) {
+        random = random * 1103515245 + 12345;
+        size_t offset = (random >> 16) % 8;
+        random = random * 1103515245 + 12345;
+        size_t len = (random >> 16) % (CRC_LEN + 1);
+        for (size_t i = 0; i < len; i++) {
+            random = random * 1103515245 + 12345;
+            buf[offset + i] = random >> 16;
+        }
+
+        uint16_t start = (n & 1) ? CRC_CCITT_INIT_VAL : (uint16_t)(random >> 8);
+        uint16_t bytewise = start;
+        for (size_t i = 0; i < len; i++)
+            bytewise = updcrc_ccitt(buf[offset + i], bytewise);
+        uint16_t sliced = crc_ccitt(start, buf + offset, len);
+        uint16_t bitwise = crcBitwise(start, buf + offset, len);
+
+        if (sliced != bytewise || sliced != bitwise) {
+            if (!bad) {
+                fprintf(stderr, "crc_ccitt is wrong for %zu bytes at offset %zu: %04X, updcrc_ccitt gives %04X, bitwise %04X\n",
+                    len, offset, sliced, bytewise, bitwise);
+            }
+            bad++;
+        }
+    }
+
+    if (bad)
+        fprintf(stderr, "crc_ccitt was wrong for %lu of %u buffers\n", bad, CRC_CHECKS);
+    return !bad;
+}
+
+#if CONFIG_AX25_FX25
+//////////////////////////////////////////////////////
+// FX.25                                            //
+//////////////////////////////////////////////////////
+
+// Correcting FX.25 blocks, which the main loop has
+// to keep up with. We use 32 check bytes, and wreck
+// as many bytes of each block as the code can fix,
+// which is the slowest case for the decoder.
+#define FX25_CHECK 32
+
+static void benchFx25(void) {
+    static uint8_t blocks[FRAMES][RS_MAX_LEN];
+    static int modes[FRAMES];
+    uint8_t frame[CONFIG_AX25_FRAME_BUF_LEN];
+    uint8_t block[RS_MAX_LEN];
+
+    for (unsigned i = 0; i < FRAMES; i++) {
+        size_t len = payload(i, frame);
+        uint16_t crc = crc_ccitt(CRC_CCITT_INIT_VAL, frame, len) ^ 0xFFFF;
+        frame[len++] = crc & 0xFF;
+        frame[len++] = crc >> 8;
+        modes[i] = fx25_encode(frame, len, FX25_CHECK, blocks[i]);
+        if (modes[i] < 0) continue;
+        for (unsigned e = 0; e < FX25_CHECK / 2; e++) {
+            blocks[i][(e * 13 + i) % fx25_blockLen(modes[i])] ^= (uint8_t)(e + 1);
+        }
+    }
+
+    double start = now(), elapsed;
+    unsigned long decoded = 0, bytes = 0, failed = 0;
+    do {
+        for (unsigned i = 0; i < FRAMES; i++) {
+            if (modes[i] < 0) continue;
+            memcpy(block, blocks[i], fx25_blockLen(modes[i]));
+            size_t len = fx25_decode(block, modes[i], NULL);
+            if (len && crc_ccitt(CRC_CCITT_INIT_VAL, block, len) == AX25_CRC_CORRECT)
+                decoded++;
+            else
+                failed++;
+            bytes += fx25_blockLen(modes[i]);
+        }
+        elapsed = now() - start;
+    } while (elapsed < minTime);
+
+    if (failed)
+        fprintf(stderr, "FX.25 decoder failed on %lu blocks\n", failed);
+    report("fx25_decode_frames_per_s", decoded / elapsed, "frames/s");
+    report("fx25_decode_bytes_per_s", bytes / elapsed, "bytes/s");
+}
+#endif
+
+//////////////////////////////////////////////////////
+// And here comes the actual program :)             //
+//////////////////////////////////////////////////////
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-t seconds]\n", name);
+    fprintf(stderr, "  -t  Run each measurement at least this long (default %.1f)\n", minTime);
+}
+
+int main(int argc, char **argv) {
+    bool failed = false;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            minTime = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Room for all the frames, with their preambles
+    // and tails, at the longest they can be
+    audio = malloc((size_t)FRAMES * (CONFIG_AX25_FRAME_BUF_LEN * 2 + (CONFIG_AFSK_PREAMBLE_LEN + CONFIG_AFSK_TRAILER_LEN) * BITRATE / 8000 + 4) * 8 * SAMPLESPERBIT);
+    if (!audio) return 1;
+
+    printf("config\tdemodulators=%d,correlator=%d,pll=%d,agc=%d,telemetry=%d,profiles=%d,g3ruh=%d,pwm_dac=%d,hdlc_table=%d,rx_frames=%d,crc_slice=%d\t-\n",
+        CONFIG_AFSK_DEMODULATORS, CONFIG_AFSK_CORRELATOR, CONFIG_AFSK_PLL, CONFIG_AFSK_AGC, CONFIG_AFSK_TELEMETRY, CONFIG_AFSK_PROFILES, CONFIG_AFSK_G3RUH, CONFIG_AFSK_PWM_DAC, CONFIG_AFSK_HDLC_TABLE, CONFIG_AFSK_RX_FRAMES, CONFIG_CRC_CCITT_SLICE);
+
+    benchTx();
+    benchDac();
+    recordBits();
+    recordBytes();
+    benchDemod();
+    #if CONFIG_AFSK_AGC
+    benchAgc();
+    #endif
+    #if CONFIG_AFSK_HDLC_TABLE
+    if (!checkHdlcTable()) failed = true;
+    #endif
+    benchHdlc();
+    benchProtocol();
+    benchRx();
+    if (!checkCrc()) failed = true;
+    benchCrc(false);
+    benchCrc(true);
+    #if CONFIG_AX25_FX25
+    benchFx25();
+    #endif
+
+    free(audio);
+    free(hdlcBits);
+    free(rxBytes);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,418 @@
+//////////////////////////////////////////////////////
+// First things first, all the includes we need     //
+//////////////////////////////////////////////////////
+
+#include "hw_host.h"        // Host stand-in for the ADC interrupt
+#include "afsk.h"           // Header for AFSK modem
+#include "protocol/KISS.h"  // KISS TNC protocol
+
+#include <net/ax25.h>       // AX.25 protocol from BertOS
+
+#include <stdio.h>          // Standard input/output
+#include <stdlib.h>         // malloc, atoi and friends
+#include <stdint.h>         // For intptr_t
+#include <string.h>         // String operations
+#include <time.h>           // For measuring decode speed
+#include <pthread.h>        // For running demodulators in parallel
+
+//////////////////////////////////////////////////////
+// A few definitions                                //
+//////////////////////////////////////////////////////
+
+static Afsk afsk;           // Declare a AFSK modem struct
+static AX25Ctx ax25;        // Declare a protocol struct
+
+static bool quiet = false;  // Only print the summary
+static bool kiss = false;   // Write frames to stdout as a KISS TNC
+static uint32_t sampleRate = SAMPLERATE; // Rate the modem wants samples at
+static unsigned long frames = 0;
+
+// How often we let the protocol look at the receive
+// FIFO. On the AVR the main loop polls all the time,
+// but since the demodulator can't produce more than
+// one byte (plus escape) per 64 samples, polling once
+// every byte-time is more than enough to keep the
+// FIFO from overflowing, and much cheaper on the host.
+#define POLL_INTERVAL (SAMPLESPERBIT * 8)
+
+// Lets the protocol look at what the modem has
+// received, the same way main.c does.
+static void poll(void) {
+    #if CONFIG_AFSK_RX_FRAMES
+    AfskFrame *frame;
+    while ((frame = afsk_getFrame(&afsk))) {
+        #if CONFIG_AFSK_SOFT_BITS
+        ax25_receiveSoft(&ax25, frame->buf, frame->len, frame->weak, frame->weakCount);
+        #else
+        ax25_receive(&ax25, frame->buf, frame->len);
+        #endif
+        afsk_freeFrame(&afsk, frame);
+    }
+    #else
+    ax25_poll(&ax25);
+    #endif
+    #if CONFIG_AX25_FX25
+    afsk_fx25Poll(&afsk, &ax25);
+    #endif
+}
+
+#if CONFIG_AFSK_DEMODULATORS > 1
+// With several demodulators, we can run them in
+// separate threads. Each thread runs its share of
+// the demodulators over a block of samples, and the
+// protocol gets to look at the results after each
+// block. The block is short enough that the receive
+// FIFO can hold the frames finished within it.
+#define BLOCK_LEN (SAMPLERATE / 4)
+
+static int threads = 1;
+static const uint8_t *block;
+static size_t blockLen;
+#if CONFIG_AFSK_AGC
+static int8_t levelled[BLOCK_LEN];
+#endif
+static bool finished = false;
+static pthread_barrier_t blockStart;
+static pthread_barrier_t blockDone;
+
+static void runDemods(int thread) {
+    for (int d = thread; d < CONFIG_AFSK_DEMODULATORS; d += threads) {
+        for (size_t i = 0; i < blockLen; i++) {
+            #if CONFIG_AFSK_AGC
+            afsk_demod_isr(&afsk, d, levelled[i]);
+            #else
+            afsk_demod_isr(&afsk, d, ((int16_t)block[i] - 128));
+            #endif
+        }
+    }
+}
+
+static void *demodThread(void *arg) {
+    int thread = (int)(intptr_t)arg;
+    for (;;) {
+        pthread_barrier_wait(&blockStart);
+        if (finished) break;
+        runDemods(thread);
+        pthread_barrier_wait(&blockDone);
+    }
+    return NULL;
+}
+
+static void decodeThreaded(const uint8_t *samples, size_t count) {
+    pthread_t tid[CONFIG_AFSK_DEMODULATORS];
+
+    pthread_barrier_init(&blockStart, NULL, threads);
+    pthread_barrier_init(&blockDone, NULL, threads);
+    for (int t = 1; t < threads; t++) {
+        pthread_create(&tid[t], NULL, demodThread, (void *)(intptr_t)t);
+    }
+
+    for (size_t pos = 0; pos < count; pos += BLOCK_LEN) {
+        block = samples + pos;
+        blockLen = MIN((size_t)BLOCK_LEN, count - pos);
+        #if CONFIG_AFSK_AGC
+        // The AGC has to see every sample once, in
+        // order, so it runs before the threads do
+        for (size_t i = 0; i < blockLen; i++) {
+            levelled[i] = afsk_agc(&afsk, (uint16_t)block[i] << 2);
+        }
+        #endif
+        pthread_barrier_wait(&blockStart);
+        runDemods(0);
+        pthread_barrier_wait(&blockDone);
+        poll();
+    }
+
+    finished = true;
+    pthread_barrier_wait(&blockStart);
+    for (int t = 1; t < threads; t++) {
+        pthread_join(tid[t], NULL);
+    }
+    pthread_barrier_destroy(&blockStart);
+    pthread_barrier_destroy(&blockDone);
+}
+#endif
+
+//////////////////////////////////////////////////////
+// Reading audio files                              //
+//////////////////////////////////////////////////////
+
+static uint32_t le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+// Reads a whole file into memory
+static uint8_t *readFile(const char *name, size_t *len) {
+    FILE *f = fopen(name, "rb");
+    if (!f) return NULL;
+
+    size_t size = 0, cap = 1 << 20;
+    uint8_t *data = malloc(cap);
+    size_t n;
+    while (data && (n = fread(data + size, 1, cap - size, f)) > 0) {
+        size += n;
+        if (size == cap) {
+            cap *= 2;
+            data = realloc(data, cap);
+        }
+    }
+    fclose(f);
+
+    *len = size;
+    return data;
+}
+
+// Converts a WAV file to 8-bit unsigned samples at
+// the modems sample rate. We take the first channel
+// only, and resample with linear interpolation if
+// the file was recorded at another rate, which lets
+// us feed it the usual 44.1KHz test CD tracks as is.
+static uint8_t *wavToSamples(const uint8_t *wav, size_t len, size_t *samples) {
+    uint16_t format = 0, channels = 0, bits = 0;
+    uint32_t rate = 0;
+    const uint8_t *pcm = NULL;
+    size_t pcmLen = 0;
+
+    size_t pos = 12;
+    while (pos + 8 <= len) {
+        uint32_t chunkLen = le32(wav + pos + 4);
+        if (!memcmp(wav + pos, "fmt ", 4) && chunkLen >= 16) {
+            format = le16(wav + pos + 8);
+            channels = le16(wav + pos + 10);
+            rate = le32(wav + pos + 12);
+            bits = le16(wav + pos + 22);
+        } else if (!memcmp(wav + pos, "data", 4)) {
+            pcm = wav + pos + 8;
+            pcmLen = MIN((size_t)chunkLen, len - pos - 8);
+        }
+        pos += 8 + chunkLen + (chunkLen & 1);
+    }
+
+    if (format != 1 || !pcm || !channels || !rate || (bits != 8 && bits != 16)) {
+        fprintf(stderr, "Unsupported WAV file, need 8 or 16 bit PCM\n");
+        return NULL;
+    }
+
+    size_t frameLen = channels * (bits / 8);
+    size_t inFrames = pcmLen / frameLen;
+    size_t outFrames = (size_t)((uint64_t)inFrames * sampleRate / rate);
+    uint8_t *out = malloc(outFrames ? outFrames : 1);
+    if (!out) return NULL;
+
+    for (size_t i = 0; i < outFrames; i++) {
+        uint64_t fixed = ((uint64_t)i * rate << 16) / sampleRate;
+        size_t idx = fixed >> 16;
+        int32_t frac = fixed & 0xFFFF;
+        int32_t a, b;
+
+        const uint8_t *p = pcm + idx * frameLen;
+        const uint8_t *q = (idx + 1 < inFrames) ? p + frameLen : p;
+        if (bits == 8) {
+            a = ((int32_t)p[0] - 128) << 8;
+            b = ((int32_t)q[0] - 128) << 8;
+        } else {
+            a = (int16_t)le16(p);
+            b = (int16_t)le16(q);
+        }
+
+        int32_t s = a + (((b - a) * frac) >> 16);
+        out[i] = (uint8_t)((s >> 8) + 128);
+    }
+
+    *samples = outFrames;
+    return out;
+}
+
+//////////////////////////////////////////////////////
+// Decoding                                         //
+//////////////////////////////////////////////////////
+
+// Called for each decoded packet. We print it the
+// same way SimpleSerial does with all fields on.
+static void message_callback(struct AX25Msg *msg) {
+    frames++;
+    if (quiet || kiss) return;
+
+    printf("SRC: [%.6s-%d] ", msg->src.call, msg->src.ssid);
+    printf("DST: [%.6s-%d] ", msg->dst.call, msg->dst.ssid);
+    printf("PATH: ");
+    for (int i = 0; i < msg->rpt_cnt; i++)
+        printf("[%.6s-%d] ", msg->rpt_lst[i].call, msg->rpt_lst[i].ssid);
+    printf("DATA: %.*s\n", (int)msg->len, msg->info);
+}
+
+// Lets the KISS code write to stdout like it
+// would write to the serial port.
+static size_t stdoutWrite(struct KFile *fd, const void *buf, size_t size) {
+    (void)fd;
+    return fwrite(buf, 1, size, stdout);
+}
+
+static KFile stdoutFile = { .write = stdoutWrite };
+
+#if CONFIG_AFSK_ISR_STATS
+static void printIsrStat(const char *name, const IsrStat *stat) {
+    fprintf(stderr, "%s ISR cycles (min/avg/max): %u/%u/%u\n", name,
+        stat->min, stat->count ? (unsigned)(stat->sum / stat->count) : 0, stat->max);
+}
+#endif
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-q] [-k] [-r] [-j threads] [-b baud] <file>\n", name);
+    fprintf(stderr, "  -q  Only print the summary\n");
+    fprintf(stderr, "  -k  Write all received frames to stdout in KISS framing\n");
+    fprintf(stderr, "  -r  File is raw 8-bit unsigned PCM at %d Hz (default if not a WAV)\n", SAMPLERATE);
+    #if CONFIG_AFSK_G3RUH
+    fprintf(stderr, "      or at %d Hz for 9600 baud\n", G3RUH_SAMPLERATE);
+    #endif
+    fprintf(stderr, "  -j  Threads to spread the %d demodulator(s) over\n", CONFIG_AFSK_DEMODULATORS);
+    #if CONFIG_AFSK_PROFILES
+    #if CONFIG_AFSK_G3RUH
+    fprintf(stderr, "  -b  Decode 1200 baud (default), 300 baud HF or 9600 baud G3RUH audio\n");
+    #else
+    fprintf(stderr, "  -b  Decode 1200 baud (default) or 300 baud HF audio\n");
+    #endif
+    #endif
+}
+
+int main(int argc, char **argv) {
+    bool raw = false;
+    const char *name = NULL;
+    #if CONFIG_AFSK_PROFILES
+    uint8_t profile = AFSK_PROFILE_1200;
+    #endif
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-q")) {
+            quiet = true;
+        } else if (!strcmp(argv[i], "-k")) {
+            kiss = true;
+        } else if (!strcmp(argv[i], "-r")) {
+            raw = true;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            int j = atoi(argv[++i]);
+            #if CONFIG_AFSK_DEMODULATORS > 1
+            threads = MINMAX(1, j, CONFIG_AFSK_DEMODULATORS);
+            #else
+            (void)j;
+            #endif
+        #if CONFIG_AFSK_PROFILES
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            int baud = atoi(argv[++i]);
+            if (baud == 300) {
+                profile = AFSK_PROFILE_300;
+            #if CONFIG_AFSK_G3RUH
+            } else if (baud == 9600) {
+                profile = AFSK_PROFILE_9600;
+            #endif
+            } else if (baud != 1200) {
+                usage(argv[0]);
+                return 2;
+            }
+        #endif
+        } else if (argv[i][0] != '-' && !name) {
+            name = argv[i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (!name) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    // Create a modem context first, so we know
+    // what rate it wants the samples at
+    afsk_init(&afsk, 0);
+    #if CONFIG_AFSK_PROFILES
+    afsk_setProfile(&afsk, profile);
+    sampleRate = afsk_sampleRate(&afsk);
+    #endif
+
+    size_t len;
+    uint8_t *data = readFile(name, &len);
+    if (!data) {
+        perror(name);
+        return 1;
+    }
+
+    uint8_t *samples = data;
+    size_t count = len;
+    if (!raw && len >= 12 && !memcmp(data, "RIFF", 4) && !memcmp(data + 8, "WAVE", 4)) {
+        samples = wavToSamples(data, len, &count);
+        free(data);
+        if (!samples) return 1;
+    }
+
+    // And a protocol context with the
+    // modem, just like main.c
+    ax25_init(&ax25, &afsk.fd, message_callback);
+    if (kiss && !quiet)
+        kiss_init(&ax25, &afsk, &stdoutFile);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    #if CONFIG_AFSK_DEMODULATORS > 1
+    if (threads > 1) {
+        decodeThreaded(samples, count);
+    } else
+    #endif
+    {
+        for (size_t i = 0; i < count; i++) {
+            hw_host_isr(samples[i]);
+            if (i % POLL_INTERVAL == 0)
+                poll();
+        }
+        poll();
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double audio = (double)count / sampleRate;
+
+    fprintf(stderr, "Frames decoded: %lu\n", frames);
+    #if CONFIG_AX25_FIX_BITS
+    fprintf(stderr, "Frames fixed: %u\n", ax25.fixed);
+    #endif
+    #if CONFIG_AX25_FX25
+    fprintf(stderr, "FX.25 frames: %u (%u bytes corrected)\n", afsk.fx25Frames, afsk.fx25Fixed);
+    #endif
+    #if CONFIG_AFSK_TELEMETRY
+    // The audio counters are only kept by
+    // afsk_adc_isr, not the threaded decoder
+    AfskStats stats;
+    afsk_getStats(&afsk, &stats);
+    fprintf(stderr, "Audio peak: %u, clipped: %u, busy: %.1f%%\n", stats.peak, stats.clipped,
+        stats.samples ? 100.0 * stats.busy / stats.samples : 0.0);
+    fprintf(stderr, "HDLC frames: %u, aborted: %u, CRC errors: %u, overruns: %u\n",
+        stats.frames, stats.aborts, ax25.crc_errors, stats.overruns);
+    if (audio > 0)
+        fprintf(stderr, "Frames per minute: %.1f\n", frames * 60 / audio);
+    #endif
+    #if CONFIG_AFSK_AGC
+    uint16_t offset, gain;
+    afsk_agcLevels(&afsk, &offset, &gain);
+    fprintf(stderr, "Input offset: %u, gain: %u.%02u\n", offset, gain / 256, (gain % 256) * 100 / 256);
+    #endif
+    fprintf(stderr, "Samples: %zu (%.1f s of audio)\n", count, audio);
+    fprintf(stderr, "Decode time: %.3f s\n", elapsed);
+    if (elapsed > 0)
+        fprintf(stderr, "Throughput: %.0f samples/s (%.1fx realtime)\n", count / elapsed, audio / elapsed);
+
+    #if CONFIG_AFSK_ISR_STATS
+    IsrStats isrStats;
+    hw_isrStats_get(&isrStats);
+    printIsrStat("ADC", &isrStats.adc);
+    printIsrStat("DAC", &isrStats.dac);
+    printIsrStat("Total", &isrStats.total);
+    #endif
+
+    free(samples);
+    return 0;
+}
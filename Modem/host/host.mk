@@ -0,0 +1,67 @@
+#
+# Host makefile.
+# Builds the modem code as plain PC programs, so the
+# demodulator and protocol code can be run and measured
+# without any hardware. Build with "make host".
+#
+
+# Our host targets
+TRG += ModemDecode
+TRG += ModemBench
+
+ModemDecode_HOSTED = 1
+
+ModemDecode_PREFIX =
+
+ModemDecode_SUFFIX =
+
+ModemDecode_SRC_PATH = Modem
+
+ModemDecode_HOST_PATH = Modem/host
+
+# Modem and BertOS sources shared with the firmware
+Modem_HOST_CSRC = \
+	$(Modem_SRC_PATH)/afsk.c \
+	$(Modem_SRC_PATH)/protocol/KISS.c \
+	$(Modem_HOST_PATH)/hw_host.c \
+	bertos/io/kfile.c \
+	bertos/mware/formatwr.c \
+	bertos/mware/hex.c \
+	bertos/net/ax25.c \
+	bertos/algo/crc_ccitt.c \
+	bertos/algo/rs.c \
+	bertos/net/fx25.c \
+	#
+
+Modem_HOST_PATH = $(ModemDecode_HOST_PATH)
+
+ModemDecode_CSRC = \
+	$(Modem_HOST_CSRC) \
+	$(ModemDecode_HOST_PATH)/decode.c \
+	#
+
+Modem_HOST_CPPFLAGS = -O2 -D'ARCH=(ARCH_DEFAULT)' -D'CPU_FREQ=(16000000UL)' \
+	-I$(Modem_HOST_PATH) -I$(Modem_SRC_PATH) -fno-strict-aliasing -fwrapv \
+	$(HOST_CPPFLAGS)
+
+ModemDecode_CPPFLAGS = $(Modem_HOST_CPPFLAGS)
+
+ModemDecode_LDFLAGS = -lpthread
+
+# The benchmark includes afsk.c itself, to get at
+# the static functions in it
+ModemBench_HOSTED = 1
+ModemBench_PREFIX =
+ModemBench_SUFFIX =
+
+ModemBench_CSRC = \
+	$(filter-out $(Modem_SRC_PATH)/afsk.c,$(Modem_HOST_CSRC)) \
+	$(ModemDecode_HOST_PATH)/bench.c \
+	#
+
+ModemBench_CPPFLAGS = $(Modem_HOST_CPPFLAGS)
+
+ModemBench_LDFLAGS = -lpthread -lm
+
+.PHONY: host
+host: $(OUTDIR)/ModemDecode.tgt $(OUTDIR)/ModemBench.tgt
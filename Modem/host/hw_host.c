@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////
+// First things first, all the includes we need     //
+//////////////////////////////////////////////////////
+
+#include "hw_host.h"        // We need the header for this code
+#include "hardware.h"       // The hardware interface we are emulating
+#include "afsk.h"           // We also need to know about the AFSK modem
+
+#include <drv/timer.h>      // Timer driver from BertOS
+
+#include <time.h>           // Fallback for counting cycles
+#include <pthread.h>        // For running demodulators in threads
+
+#if defined(__i386__) || defined(__x86_64__)
+    #include <x86intrin.h>  // For reading the timestamp counter
+#endif
+
+// A reference to our modem "object"
+static Afsk *modem;
+
+// The same flags the AVR interrupt looks at
+bool hw_ptt_on;
+bool hw_afsk_dac_isr;
+
+// There is no timer interrupt on the host, so we
+// keep the system clock ourselves, and advance it
+// as samples go by. This way everything that looks
+// at timer_clock() sees time passing exactly as fast
+// as the audio we are being fed, no matter how fast
+// we actually process it.
+volatile ticks_t _clock;
+static uint16_t clockAcc;
+static uint16_t sampleRate = CONFIG_AFSK_DAC_SAMPLERATE;
+
+#if CONFIG_AFSK_ISR_STATS
+// Cycle counts for our emulated ADC interrupt
+IsrStats hw_isrStats;
+#endif
+
+//////////////////////////////////////////////////////
+// And now for the actual hardware functions        //
+//////////////////////////////////////////////////////
+
+void hw_afsk_adcInit(int ch, Afsk *_modem)
+{
+    (void)ch;
+    modem = _modem;
+}
+
+// We are fed samples at whatever rate they come, so
+// we only need to know it to keep the clock right
+void hw_afsk_adcRate(uint16_t rate)
+{
+    sampleRate = rate;
+}
+
+// Lock for demodulators running in different threads
+static pthread_mutex_t demodLock = PTHREAD_MUTEX_INITIALIZER;
+
+void hw_host_lock(void)
+{
+    pthread_mutex_lock(&demodLock);
+}
+
+void hw_host_unlock(void)
+{
+    pthread_mutex_unlock(&demodLock);
+}
+
+uint16_t hw_host_cycles(void)
+{
+    #if defined(__i386__) || defined(__x86_64__)
+    return (uint16_t)__rdtsc();
+    #else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint16_t)now.tv_nsec;
+    #endif
+}
+
+uint8_t hw_host_isr(uint8_t sample)
+{
+    uint8_t out;
+
+    #if CONFIG_AFSK_ISR_STATS
+    uint16_t isrStart = HW_CYCLES();
+    uint16_t start = isrStart;
+    #endif
+
+    // Exactly what DECLARE_ISR(ADC_vect) does, only
+    // our sample is already 8 bits wide.
+    #if CONFIG_AFSK_AGC
+    afsk_adc_isr(modem, afsk_agc(modem, (uint16_t)sample << 2));
+    #else
+    afsk_adc_isr(modem, ((int16_t)sample - 128));
+    #endif
+
+    #if CONFIG_AFSK_ISR_STATS
+    hw_isrStat_add(&hw_isrStats.adc, HW_CYCLES_SINCE(start));
+    #endif
+
+    if (hw_afsk_dac_isr) {
+        #if CONFIG_AFSK_ISR_STATS
+        start = HW_CYCLES();
+        #endif
+        out = (afsk_dac_isr(modem) & 0xF0) | BV(3);
+        #if CONFIG_AFSK_ISR_STATS
+        hw_isrStat_add(&hw_isrStats.dac, HW_CYCLES_SINCE(start));
+        #endif
+    } else {
+        out = hw_ptt_on ? 136 : 128;
+    }
+
+    #if CONFIG_AFSK_ISR_STATS
+    hw_isrStat_add(&hw_isrStats.total, HW_CYCLES_SINCE(isrStart));
+    #endif
+
+    clockAcc += TIMER_TICKS_PER_SEC;
+    if (clockAcc >= sampleRate) {
+        clockAcc -= sampleRate;
+        _clock++;
+    }
+
+    return out;
+}
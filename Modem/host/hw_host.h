@@ -0,0 +1,22 @@
+//////////////////////////////////////////////////////
+// First things first, all the includes we need     //
+//////////////////////////////////////////////////////
+
+#ifndef FSK_MODEM_HW_HOST
+#define FSK_MODEM_HW_HOST
+
+#include <cfg/compiler.h>       // Compiler info from BertOS
+
+//////////////////////////////////////////////////////
+// Host (PC) stand-in for the modem hardware        //
+//////////////////////////////////////////////////////
+
+// This is the host counterpart of the ADC interrupt
+// in "hardware.c". It takes one raw 8-bit sample, just
+// like the one the ADC would give us, runs it through
+// the demodulator, and then lets the modulator produce
+// the next output sample. The return value is what the
+// AVR would have written to PORTD.
+uint8_t hw_host_isr(uint8_t sample);
+
+#endif
@@ -25,8 +25,6 @@
     #include "cfg/debug.h"  // Debug configuration from BertOS
 #endif
 
-#define SERIAL_PROTOCOL PROTOCOL_SIMPLE_SERIAL
-
 //////////////////////////////////////////////////////
 // A few definitions                                //
 //////////////////////////////////////////////////////
@@ -38,14 +36,15 @@ static Serial ser;          // Declare a serial interface struct
 #define ADC_CH 0            // Define which channel (pin) we want
                             // for the ADC (this is A0 on arduino)
 
-
-static uint8_t serialBuffer[CONFIG_AX25_FRAME_BUF_LEN+1]; // Buffer for holding incoming serial data
 static int sbyte;                               // For holding byte read from serial port
+#if SERIAL_PROTOCOL == PROTOCOL_SIMPLE_SERIAL
+static uint8_t serialBuffer[CONFIG_AX25_FRAME_BUF_LEN+1]; // Buffer for holding incoming serial data
 static size_t serialLen = 0;                    // Counter for counting length of data from serial
 static bool sertx = false;                      // Flag signifying whether it's time to send data
                                                 // received on the serial port.
 
 #define SER_BUFFER_FULL (serialLen < CONFIG_AX25_FRAME_BUF_LEN-1)
+#endif
 
 
 
@@ -56,14 +55,13 @@ static bool sertx = false;                      // Flag signifying whether it's
 // This is a callback we register with the protocol,
 // so we can process each packet as they are decoded.
 // Right now it just prints the packet to the serial port.
+// In KISS mode the protocol hands the raw frames straight
+// to the KISS code instead, so there is nothing to do here.
 static void message_callback(struct AX25Msg *msg)
 {
     if (SERIAL_PROTOCOL == PROTOCOL_SIMPLE_SERIAL) {
         ss_messageCallback(msg, &ser);
     }
-    if (SERIAL_PROTOCOL == PROTOCOL_KISS) {
-        // Not implemented yet
-    }
 }
 
 // Simple initialization function.
@@ -90,8 +88,14 @@ static void init(void)
     // ... and a protocol context with the modem
     ax25_init(&ax25, &afsk.fd, message_callback);
 
+    #if SERIAL_PROTOCOL == PROTOCOL_KISS
+    // Init KISS, which gets the raw frames
+    // from the protocol
+    kiss_init(&ax25, &afsk, &ser.fd);
+    #else
     // Init SimpleSerial
     ss_init(&ax25);
+    #endif
 
     // That's all!
 }
@@ -100,16 +104,49 @@ int main(void)
 {
     // Start by running the main initialization
     init();
+    #if SERIAL_PROTOCOL == PROTOCOL_SIMPLE_SERIAL
     // Record the current tick count for time-keeping
     ticks_t start = timer_clock();
+    #endif
     
     // Go into ye good ol' infinite loop
     while (1)
     {    
         // First we instruct the protocol to check for
         // incoming data
+        #if CONFIG_AFSK_RX_FRAMES
+        // When the modem receives whole frames, we
+        // hand each of them to the protocol, and
+        // then back to the modem.
+        AfskFrame *frame;
+        while ((frame = afsk_getFrame(&afsk))) {
+            #if CONFIG_AFSK_SOFT_BITS
+            // Along with the bits the modem was least
+            // sure of, in case the CRC doesn't match
+            ax25_receiveSoft(&ax25, frame->buf, frame->len, frame->weak, frame->weakCount);
+            #else
+            ax25_receive(&ax25, frame->buf, frame->len);
+            #endif
+            afsk_freeFrame(&afsk, frame);
+        }
+        #else
         ax25_poll(&ax25);
-
+        #endif
+
+        #if CONFIG_AX25_FX25
+        // And any FX.25 block the modem has received
+        // gets corrected and handed over too.
+        afsk_fx25Poll(&afsk, &ax25);
+        #endif
+
+        #if SERIAL_PROTOCOL == PROTOCOL_KISS
+        // In KISS mode the host frames its data itself,
+        // so we give the KISS code every byte as soon as
+        // it arrives, and it knows when to transmit.
+        while ((sbyte = ser_getchar_nowait(&ser)) != EOF) {
+            kiss_serialCallback(sbyte);
+        }
+        #else
         // Poll for incoming serial data
         if (!sertx && ser_available(&ser)) {
             // We then read a byte from the serial port.
@@ -170,6 +207,7 @@ int main(void)
             sertx = false;
             serialLen = 0;
         }
+        #endif
 
     }
     return 0;
@@ -0,0 +1,154 @@
+#include "protocol/KISS.h"
+
+// KISS lets a host program on the other end of the
+// serial port use us as a plain packet modem. We
+// hand it every frame we receive as is, and send
+// every frame it gives us as is. Both directions
+// are framed the same way: a FEND, a command byte,
+// the data with FEND and FESC escaped, and a FEND.
+
+static AX25Ctx *ax25ctx;    // The protocol we send frames with
+static Afsk *modem;         // The modem, for its TX settings
+static KFile *serial;       // The host on the serial port
+
+// The frame we are receiving from the host. We don't
+// keep it anywhere, data goes straight to the modem as
+// it comes in, and a parameter is a single byte. The
+// command is unknown until we get the first byte.
+#define CMD_UNKNOWN 0xFE
+static uint8_t command = CMD_UNKNOWN;
+static size_t frameLen = 0;
+static uint8_t value;
+static bool inFrame = false;
+static bool escape = false;
+
+void kiss_init(AX25Ctx *ax25, Afsk *afsk, KFile *host) {
+    ax25ctx = ax25;
+    modem = afsk;
+    serial = host;
+
+    // We want every frame the protocol receives,
+    // not just the APRS messages it decodes.
+    ax25->frame_hook = kiss_frameCallback;
+}
+
+// Called by the protocol with every frame it has
+// received with a good CRC. We send it on to the
+// host without the CRC, like KISS expects.
+void kiss_frameCallback(const uint8_t *frame, size_t len) {
+    kfile_putc(FEND, serial);
+    kfile_putc(CMD_DATA, serial);
+    for (size_t i = 0; i < len; i++) {
+        uint8_t b = frame[i];
+        if (b == FEND) {
+            kfile_putc(FESC, serial);
+            kfile_putc(TFEND, serial);
+        } else if (b == FESC) {
+            kfile_putc(FESC, serial);
+            kfile_putc(TFESC, serial);
+        } else {
+            kfile_putc(b, serial);
+        }
+    }
+    kfile_putc(FEND, serial);
+}
+
+// Acts on a complete frame from the host
+static void kiss_frameDone(void) {
+    if (frameLen == 0) return;
+
+    switch (command) {
+        case CMD_DATA:
+            // The data is all with the modem already,
+            // so we finish the frame and let it key up.
+            ax25_sendEnd(ax25ctx);
+            afsk_txHold(modem, false);
+            break;
+        case CMD_TXDELAY:
+            // The ADC ISR reads this when it keys up,
+            // and it's more than a byte, so the write
+            // must be atomic.
+            ATOMIC(modem->preambleTime = value * 10);
+            break;
+        case CMD_P:
+            modem->persistence = value;
+            break;
+        case CMD_SLOTTIME:
+            modem->slotTime = value;
+            break;
+        case CMD_TXTAIL:
+            // The tail length is set the same way
+            ATOMIC(modem->tailTime = value * 10);
+            break;
+        case CMD_FULLDUPLEX:
+            modem->fullDuplex = (value != 0);
+            break;
+        #if CONFIG_AX25_FX25
+        case CMD_SETHARDWARE:
+            // The only hardware setting we have is
+            // FX.25: the number of check bytes to send
+            // frames with, or 0 for plain AX.25.
+            if (value == 0 || value == 16 || value == 32 || value == 64)
+                ax25ctx->fx25 = value;
+            break;
+        #endif
+        default:
+            // Return is ignored, since KISS is the
+            // only mode we have.
+            break;
+    }
+}
+
+// Called with every byte we get from the host
+void kiss_serialCallback(uint8_t sbyte) {
+    if (sbyte == FEND) {
+        // A FEND both ends a frame and starts the
+        // next one, so back to back frames can share
+        // it. Frames with nothing in them are just
+        // the host keeping the line in sync.
+        if (inFrame) kiss_frameDone();
+        inFrame = true;
+        escape = false;
+        command = CMD_UNKNOWN;
+        frameLen = 0;
+        return;
+    }
+    if (!inFrame) return;
+
+    if (escape) {
+        if (sbyte == TFEND) sbyte = FEND;
+        if (sbyte == TFESC) sbyte = FESC;
+        escape = false;
+    } else if (sbyte == FESC) {
+        escape = true;
+        return;
+    }
+
+    if (command == CMD_UNKNOWN) {
+        // The first byte is the command. Anything
+        // not for port 0 is not for us, and we
+        // wait for the next frame.
+        if (sbyte == CMD_RETURN || (sbyte >> 4) != 0) {
+            inFrame = false;
+        } else {
+            command = sbyte;
+        }
+        return;
+    }
+
+    if (command == CMD_DATA) {
+        // Data goes to the modem right away, so it
+        // can be encoded while the rest comes in.
+        // We hold off keying up until we have it
+        // all, so a slow host can't make us run
+        // out of data in the middle of the frame.
+        if (frameLen == 0) {
+            afsk_txHold(modem, true);
+            ax25_sendStart(ax25ctx);
+        }
+        ax25_sendByte(ax25ctx, sbyte);
+    } else if (frameLen == 0) {
+        value = sbyte;
+    }
+    frameLen++;
+}
@@ -1,10 +1,31 @@
-#ifndef PROTOCOL_KISS
-#define PROTOCOL_KISS 0x02
+#ifndef PROTOCOL_KISS_H
+#define PROTOCOL_KISS_H
 
+#include <net/ax25.h>
+#include <io/kfile.h>
+#include "afsk.h"
+
+// Special characters in the KISS framing
 #define FEND 0xC0
 #define FESC 0xDB
 #define TFEND 0xDC
 #define TFESC 0xDD
 
+// KISS commands. The low nibble of the first byte
+// in a frame is the command, the high nibble is the
+// port, which we only have one of.
+#define CMD_DATA 0x00
+#define CMD_TXDELAY 0x01
+#define CMD_P 0x02
+#define CMD_SLOTTIME 0x03
+#define CMD_TXTAIL 0x04
+#define CMD_FULLDUPLEX 0x05
+#define CMD_SETHARDWARE 0x06
+#define CMD_RETURN 0xFF
+
+void kiss_init(AX25Ctx *ax25, Afsk *afsk, KFile *host);
+
+void kiss_frameCallback(const uint8_t *frame, size_t len);
+void kiss_serialCallback(uint8_t sbyte);
 
-#endif
\ No newline at end of file
+#endif
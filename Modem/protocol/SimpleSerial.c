@@ -6,6 +6,9 @@
 #define F_CPU 16000000UL
 #include <util/delay.h>
 #include "protocol/SimpleSerial.h"
+#include "hardware.h"
+#include "afsk.h"
+#include <drv/timer.h>
 
 bool PRINT_SRC = true;
 bool PRINT_DST = true;
@@ -34,6 +37,10 @@ int PATH2_SSID = 2;
 AX25Call path[4];
 AX25Ctx *ax25ctx;
 
+#if CONFIG_AFSK_TELEMETRY
+ticks_t statsStart;
+#endif
+
 #define NV_MAGIC_BYTE 0x69
 uint8_t EEMEM nvMagicByte;
 uint8_t EEMEM nvCALL[6];
@@ -58,6 +65,13 @@ uint8_t EEMEM nvDIRECTIVITY;
 uint8_t EEMEM nvSYMBOL_TABLE;
 uint8_t EEMEM nvSYMBOL;
 uint8_t EEMEM nvAUTOACK;
+#if CONFIG_AFSK_PROFILES
+uint8_t EEMEM nvPROFILE;
+#endif
+#if CONFIG_AFSK_TX_LEVELS
+uint8_t EEMEM nvMARK_LEVEL;
+uint8_t EEMEM nvSPACE_LEVEL;
+#endif
 
 // Location packet assembly fields
 char latitude[8];
@@ -83,6 +97,9 @@ bool message_autoAck = false;
 
 void ss_init(AX25Ctx *ax25) {
     ax25ctx = ax25;
+    #if CONFIG_AFSK_TELEMETRY
+    statsStart = timer_clock();
+    #endif
     ss_loadSettings();
     SS_INIT = true;
     if (VERBOSE) {
@@ -131,6 +148,20 @@ void ss_loadSettings(void) {
         symbol = eeprom_read_byte((void*)&nvSYMBOL);
         message_autoAck = eeprom_read_byte((void*)&nvAUTOACK);
 
+        #if CONFIG_AFSK_PROFILES
+        // Configurations saved before there were
+        // profiles don't have a valid one stored
+        uint8_t profile = eeprom_read_byte((void*)&nvPROFILE);
+        if (profile < AFSK_PROFILES) afsk_setProfile(AFSK_CAST(ax25ctx->ch), profile);
+        #endif
+
+        #if CONFIG_AFSK_TX_LEVELS
+        // The same goes for the tone levels
+        uint8_t markLevel = eeprom_read_byte((void*)&nvMARK_LEVEL);
+        uint8_t spaceLevel = eeprom_read_byte((void*)&nvSPACE_LEVEL);
+        if (markLevel <= 100 && spaceLevel <= 100) afsk_setTxLevels(AFSK_CAST(ax25ctx->ch), markLevel, spaceLevel);
+        #endif
+
         if (VERBOSE && SS_INIT) kprintf("Configuration loaded\n");
     } else {
         if (SS_INIT && !SILENT && VERBOSE) kprintf("Error: No stored configuration to load!\n");
@@ -165,6 +196,15 @@ void ss_saveSettings(void) {
     eeprom_update_byte((void*)&nvSYMBOL_TABLE, symbolTable);
     eeprom_update_byte((void*)&nvSYMBOL, symbol);
     eeprom_update_byte((void*)&nvAUTOACK, message_autoAck);
+    #if CONFIG_AFSK_PROFILES
+    eeprom_update_byte((void*)&nvPROFILE, afsk_getProfile(AFSK_CAST(ax25ctx->ch)));
+    #endif
+    #if CONFIG_AFSK_TX_LEVELS
+    uint8_t markLevel, spaceLevel;
+    afsk_getTxLevels(AFSK_CAST(ax25ctx->ch), &markLevel, &spaceLevel);
+    eeprom_update_byte((void*)&nvMARK_LEVEL, markLevel);
+    eeprom_update_byte((void*)&nvSPACE_LEVEL, spaceLevel);
+    #endif
 
     eeprom_update_byte((void*)&nvMagicByte, NV_MAGIC_BYTE);
 
@@ -308,6 +348,35 @@ void ss_serialCallback(void *_buffer, size_t length, Serial *ser, AX25Ctx *ctx)
             ss_printHelp();
         }
         #endif
+        #if CONFIG_AFSK_ISR_STATS
+        else if (buffer[0] == 'i') {
+            ss_printIsrStats();
+            if (length > 1 && buffer[1] == 'r') hw_isrStats_reset();
+        }
+        #endif
+        #if CONFIG_AFSK_AGC
+        else if (buffer[0] == 'a') {
+            ss_printAgc();
+        }
+        #endif
+        #if CONFIG_AFSK_TELEMETRY
+        else if (buffer[0] == 't') {
+            ss_printTelemetry();
+            if (length > 1 && buffer[1] == 'r') ss_resetTelemetry();
+        }
+        #endif
+        #if CONFIG_AFSK_PROFILES
+        else if (buffer[0] == 'b' && length > 1) {
+            buffer++; length--;
+            ss_setBaudrate(buffer, length);
+        }
+        #endif
+        #if CONFIG_AFSK_TX_LEVELS
+        else if (buffer[0] == 'e' && length > 1) {
+            buffer++; length--;
+            ss_setTxLevels(buffer, length);
+        }
+        #endif
         else if (buffer[0] == 'H') {
             ss_printSettings();
         } else if (buffer[0] == 'S') {
@@ -761,7 +830,160 @@ void ss_printSettings(void) {
     if (symbolTable == '\\') kprintf("Symbol table: alternate\n");
     if (symbolTable == '/') kprintf("Symbol table: standard\n");
     kprintf("Symbol: %c\n", symbol);
+    #if CONFIG_AFSK_PROFILES
+    kprintf("Baudrate: %d\n", ss_baudrate());
+    #endif
+    #if CONFIG_AFSK_TX_LEVELS
+    uint8_t markLevel, spaceLevel;
+    afsk_getTxLevels(AFSK_CAST(ax25ctx->ch), &markLevel, &spaceLevel);
+    kprintf("TX levels: mark %d%%, space %d%%\n", markLevel, spaceLevel);
+    #endif
+}
+
+#if CONFIG_AFSK_ISR_STATS
+static uint16_t isrStatAvg(const IsrStat *stat) {
+    return stat->count ? stat->sum / stat->count : 0;
+}
+
+void ss_printIsrStats(void) {
+    IsrStats stats;
+    hw_isrStats_get(&stats);
+    if (VERBOSE) {
+        kprintf("ISR cycles (min/avg/max):\n");
+        kprintf("ADC: %u/%u/%u\n", stats.adc.min, isrStatAvg(&stats.adc), stats.adc.max);
+        kprintf("DAC: %u/%u/%u\n", stats.dac.min, isrStatAvg(&stats.dac), stats.dac.max);
+        kprintf("Total: %u/%u/%u\n", stats.total.min, isrStatAvg(&stats.total), stats.total.max);
+    } else {
+        kprintf("%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+            stats.adc.min, isrStatAvg(&stats.adc), stats.adc.max,
+            stats.dac.min, isrStatAvg(&stats.dac), stats.dac.max,
+            stats.total.min, isrStatAvg(&stats.total), stats.total.max);
+    }
+}
+#endif
+
+#if CONFIG_AFSK_AGC
+void ss_printAgc(void) {
+    uint16_t offset, gain;
+    afsk_agcLevels(AFSK_CAST(ax25ctx->ch), &offset, &gain);
+    if (VERBOSE) {
+        kprintf("Input offset: %u (512 is centered)\n", offset);
+        kprintf("Input gain: %u.%02u\n", gain / 256, (gain % 256) * 100 / 256);
+    } else {
+        kprintf("%u,%u\n", offset, gain);
+    }
+}
+#endif
+
+#if CONFIG_AFSK_PROFILES
+int ss_baudrate(void) {
+    uint8_t profile = afsk_getProfile(AFSK_CAST(ax25ctx->ch));
+    #if CONFIG_AFSK_G3RUH
+    if (profile == AFSK_PROFILE_9600) return 9600;
+    #endif
+    return profile == AFSK_PROFILE_300 ? 300 : 1200;
+}
+
+void ss_setBaudrate(void *_buffer, size_t length) {
+    uint8_t *buffer = (uint8_t *)_buffer;
+    int baud = 0;
+    for (size_t i = 0; i < length && buffer[i] >= 48 && buffer[i] <= 57; i++) {
+        baud = baud * 10 + buffer[i] - 48;
+    }
+
+    #if CONFIG_AFSK_G3RUH
+    if (baud == 9600) {
+        afsk_setProfile(AFSK_CAST(ax25ctx->ch), AFSK_PROFILE_9600);
+        if (VERBOSE) kprintf("Baudrate set to %d\n", baud);
+        if (!VERBOSE && !SILENT) kprintf("1\n");
+    } else
+    #endif
+    if (baud == 1200 || baud == 300) {
+        afsk_setProfile(AFSK_CAST(ax25ctx->ch), baud == 300 ? AFSK_PROFILE_300 : AFSK_PROFILE_1200);
+        if (VERBOSE) kprintf("Baudrate set to %d\n", baud);
+        if (!VERBOSE && !SILENT) kprintf("1\n");
+    } else {
+        #if CONFIG_AFSK_G3RUH
+        if (VERBOSE) kprintf("Error: Baudrate must be 1200, 300 or 9600\n");
+        #else
+        if (VERBOSE) kprintf("Error: Baudrate must be 1200 or 300\n");
+        #endif
+        if (!VERBOSE && !SILENT) kprintf("0\n");
+    }
+}
+#endif
+
+#if CONFIG_AFSK_TX_LEVELS
+// Takes the levels of the mark and space tones,
+// in percent, separated by a comma, like "100,70"
+void ss_setTxLevels(void *_buffer, size_t length) {
+    uint8_t *buffer = (uint8_t *)_buffer;
+    int levels[2] = {0, 0};
+    uint8_t count = 0;
+    bool digits = false;
+    for (size_t i = 0; i < length && count < 2; i++) {
+        if (buffer[i] >= 48 && buffer[i] <= 57) {
+            if (levels[count] <= 100) levels[count] = levels[count] * 10 + buffer[i] - 48;
+            digits = true;
+        } else if (buffer[i] == ',' && digits) {
+            count++;
+            digits = false;
+        } else {
+            break;
+        }
+    }
+    if (digits) count++;
+
+    if (count == 2 && levels[0] <= 100 && levels[1] <= 100) {
+        afsk_setTxLevels(AFSK_CAST(ax25ctx->ch), levels[0], levels[1]);
+        if (VERBOSE) kprintf("TX levels set to mark %d%%, space %d%%\n", levels[0], levels[1]);
+        if (!VERBOSE && !SILENT) kprintf("1\n");
+    } else {
+        if (VERBOSE) kprintf("Error: Levels must be two percentages, like 100,70\n");
+        if (!VERBOSE && !SILENT) kprintf("0\n");
+    }
+}
+#endif
+
+#if CONFIG_AFSK_TELEMETRY
+void ss_printTelemetry(void) {
+    Afsk *afsk = AFSK_CAST(ax25ctx->ch);
+    AfskStats stats;
+    afsk_getStats(afsk, &stats);
+    uint16_t frames = ax25ctx->frames;
+    uint16_t crcErrors = ax25ctx->crc_errors;
+
+    // How long the counters have been running, and
+    // from that the frames per minute and how busy
+    // the channel was, in percent
+    uint32_t seconds = ticks_to_ms(timer_clock() - statsStart) / 1000;
+    uint16_t perMinute = seconds ? (uint32_t)frames * 60 / seconds : 0;
+    uint32_t busy = stats.samples >= 100 ? stats.busy / (stats.samples / 100) : 0;
+    if (busy > 100) busy = 100;
+    bool dcd = afsk_dcd(afsk);
+
+    if (VERBOSE) {
+        kprintf("Audio peak: %u, clipped: %u\n", stats.peak, stats.clipped);
+        kprintf("DCD: %s, busy: %u%%\n", dcd ? "on" : "off", (unsigned)busy);
+        kprintf("HDLC frames: %u, aborted: %u\n", stats.frames, stats.aborts);
+        kprintf("Good frames: %u, CRC errors: %u\n", frames, crcErrors);
+        kprintf("Overruns: %u\n", stats.overruns);
+        kprintf("Frames per minute: %u over %lu s\n", perMinute, seconds);
+    } else {
+        kprintf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%lu\n",
+            stats.peak, stats.clipped, dcd, (unsigned)busy,
+            stats.frames, stats.aborts, frames, crcErrors,
+            stats.overruns, perMinute, seconds);
+    }
+}
+
+void ss_resetTelemetry(void) {
+    afsk_resetStats(AFSK_CAST(ax25ctx->ch));
+    ax25ctx->frames = 0;
+    ax25ctx->crc_errors = 0;
+    statsStart = timer_clock();
 }
+#endif
 
 #if ENABLE_HELP
     void ss_printHelp(void) {
@@ -807,6 +1029,25 @@ void ss_printSettings(void) {
             kprintf("L         Load configuration\n");
             kprintf("C         Clear configuration\n");
             kprintf("H         Print configuration\n");
+            #if CONFIG_AFSK_ISR_STATS
+            kprintf("i[r]      Print ISR cycle counts (r = and reset)\n");
+            #endif
+            #if CONFIG_AFSK_AGC
+            kprintf("a         Print input offset and gain\n");
+            #endif
+            #if CONFIG_AFSK_TELEMETRY
+            kprintf("t[r]      Print reception counters (r = and reset)\n");
+            #endif
+            #if CONFIG_AFSK_PROFILES
+            #if CONFIG_AFSK_G3RUH
+            kprintf("b<baud>   Set baudrate, 1200 for VHF, 300 for HF or 9600 G3RUH\n");
+            #else
+            kprintf("b<baud>   Set baudrate, 1200 for VHF or 300 for HF\n");
+            #endif
+            #endif
+            #if CONFIG_AFSK_TX_LEVELS
+            kprintf("e<m>,<s>  Set mark and space tone levels in percent\n");
+            #endif
             kprintf("----------------------------------\n");
     }
 #endif
\ No newline at end of file
@@ -1,9 +1,9 @@
-#ifndef PROTOCOL_SIMPLE_SERIAL
+#ifndef PROTOCOL_SIMPLE_SERIAL_H
+#define PROTOCOL_SIMPLE_SERIAL_H
+
 #include <net/ax25.h>
 #include <drv/ser.h>
 
-#define PROTOCOL_SIMPLE_SERIAL 0x01
-
 #define DEFAULT_CALLSIGN "NOCALL"
 #define DEFAULT_DESTINATION_CALL "APZMDM"
 
@@ -23,5 +23,12 @@ void ss_saveSettings(void);
 void ss_printSettings(void);
 
 void ss_printHelp(void);
+void ss_printIsrStats(void);
+void ss_printAgc(void);
+void ss_printTelemetry(void);
+void ss_resetTelemetry(void);
+int ss_baudrate(void);
+void ss_setBaudrate(void *_buffer, size_t length);
+void ss_setTxLevels(void *_buffer, size_t length);
 
 #endif
\ No newline at end of file
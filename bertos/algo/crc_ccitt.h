@@ -42,11 +42,35 @@
 #ifndef ALGO_CRC_CCITT_H
 #define ALGO_CRC_CCITT_H
 
+#include "cfg/cfg_crc_ccitt.h"
+
 #include <cfg/compiler.h>
 #include <cpu/pgm.h>
 
+#if CONFIG_CRC_CCITT_SLICE != 0 && CONFIG_CRC_CCITT_SLICE != 1 \
+		&& CONFIG_CRC_CCITT_SLICE != 4 && CONFIG_CRC_CCITT_SLICE != 8
+	#error CONFIG_CRC_CCITT_SLICE must be 0, 1, 4 or 8
+#endif
+
 EXTERN_C_BEGIN
 
+#if CONFIG_CRC_CCITT_SLICE == 0
+
+/* CRC table, one entry per nibble */
+extern const uint16_t crc_ccitt_nibble_tab[16];
+
+/**
+ * \brief Compute the updated CRC-CCITT value for one octet (inline version)
+ */
+INLINE uint16_t updcrc_ccitt(uint8_t c, uint16_t oldcrc)
+{
+	oldcrc ^= c;
+	oldcrc = (oldcrc >> 4) ^ pgm_read16(&crc_ccitt_nibble_tab[oldcrc & 0xf]);
+	return (oldcrc >> 4) ^ pgm_read16(&crc_ccitt_nibble_tab[oldcrc & 0xf]);
+}
+
+#else
+
 /* CRC table */
 extern const uint16_t crc_ccitt_tab[256];
 
@@ -58,12 +82,16 @@ INLINE uint16_t updcrc_ccitt(uint8_t c, uint16_t oldcrc)
 	return (oldcrc >> 8) ^ pgm_read16(&crc_ccitt_tab[(oldcrc ^ c) & 0xff]);
 }
 
+#endif
+
 /** CRC-CCITT init value */
 #define CRC_CCITT_INIT_VAL ((uint16_t)0xFFFF)
 
 
 /**
  * This function implements the CRC-CCITT calculation on a buffer.
+ * Depending on CONFIG_CRC_CCITT_SLICE, it works on 1, 4 or 8 bytes
+ * at a time, so prefer it to updcrc_ccitt() for whole buffers.
  *
  * \param crc  Current CRC-CCITT value.
  * \param buf  The buffer to perform CRC calculation on.
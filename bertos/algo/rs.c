@@ -0,0 +1,304 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2009 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Reed-Solomon codes over GF(2^8) (implementation).
+ *
+ * The decoder finds the syndromes, then the error locator polynomial
+ * with Berlekamp-Massey, its roots with a Chien search and finally the
+ * error values with Forney's formula.
+ */
+
+#include "rs.h"
+
+#include <cfg/debug.h>
+#include <cpu/pgm.h>
+
+#include <string.h>
+
+/* Powers of the primitive element, and their inverse */
+static const uint8_t PROGMEM gf_exp[255] = {
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8,
+	0xcd, 0x87, 0x13, 0x26, 0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9,
+	0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0, 0x9d, 0x27, 0x4e, 0x9c,
+	0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+	0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2,
+	0xb9, 0x6f, 0xde, 0xa1, 0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc,
+	0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0, 0xfd, 0xe7, 0xd3, 0xbb,
+	0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+	0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68,
+	0xd0, 0xbd, 0x67, 0xce, 0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93,
+	0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc, 0x85, 0x17, 0x2e, 0x5c,
+	0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+	0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72,
+	0xe4, 0xd5, 0xb7, 0x73, 0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e,
+	0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff, 0xe3, 0xdb, 0xab, 0x4b,
+	0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+	0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0,
+	0xdd, 0xa7, 0x53, 0xa6, 0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef,
+	0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09, 0x12, 0x24, 0x48, 0x90,
+	0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+	0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8,
+	0xad, 0x47, 0x8e,
+};
+
+static const uint8_t PROGMEM gf_log[256] = {
+	0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee,
+	0x1b, 0x68, 0xc7, 0x4b, 0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81,
+	0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71, 0x05, 0x8a, 0x65, 0x2f,
+	0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+	0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78,
+	0x4d, 0xe4, 0x72, 0xa6, 0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd,
+	0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88, 0x36, 0xd0, 0x94, 0xce,
+	0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+	0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54,
+	0xfa, 0x85, 0xba, 0x3d, 0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b,
+	0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57, 0x07, 0x70, 0xc0, 0xf7,
+	0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+	0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9,
+	0x23, 0x20, 0x89, 0x2e, 0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd,
+	0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61, 0xf2, 0x56, 0xd3, 0xab,
+	0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+	0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec,
+	0x7f, 0x0c, 0x6f, 0xf6, 0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa,
+	0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a, 0xcb, 0x59, 0x5f, 0xb0,
+	0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+	0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea,
+	0xa8, 0x50, 0x58, 0xaf,
+};
+
+/* Stands for log(0), which doesn't exist */
+#define GF_ZERO 0xff
+
+INLINE uint8_t gf_pow(uint16_t e)
+{
+	return pgm_read8(&gf_exp[e % 255]);
+}
+
+INLINE uint8_t gf_log_of(uint8_t x)
+{
+	return x ? pgm_read8(&gf_log[x]) : GF_ZERO;
+}
+
+INLINE uint8_t gf_mul(uint8_t a, uint8_t b)
+{
+	if (!a || !b)
+		return 0;
+	return gf_pow(pgm_read8(&gf_log[a]) + pgm_read8(&gf_log[b]));
+}
+
+INLINE uint8_t gf_div(uint8_t a, uint8_t b)
+{
+	if (!a)
+		return 0;
+	return gf_pow(255 + pgm_read8(&gf_log[a]) - pgm_read8(&gf_log[b]));
+}
+
+/*
+ * Generator polynomial, with its roots at a^1 .. a^nroots.
+ * gen[i] is the coefficient of x^i, gen[nroots] is always 1.
+ */
+static void rs_generator(uint8_t *gen, uint8_t nroots)
+{
+	memset(gen, 0, nroots + 1);
+	gen[0] = 1;
+	for (uint8_t i = 1; i <= nroots; i++)
+	{
+		/* Multiply by (x + a^i) */
+		uint8_t root = gf_pow(i);
+		for (uint8_t j = i; j > 0; j--)
+			gen[j] = gen[j - 1] ^ gf_mul(gen[j], root);
+		gen[0] = gf_mul(gen[0], root);
+	}
+}
+
+void rs_encode(const uint8_t *data, size_t len, uint8_t *parity, uint8_t nroots)
+{
+	uint8_t gen[RS_MAX_ROOTS + 1];
+
+	ASSERT(nroots <= RS_MAX_ROOTS);
+	ASSERT(len + nroots <= RS_MAX_LEN);
+
+	rs_generator(gen, nroots);
+
+	/*
+	 * Divide data * x^nroots by the generator, the remainder is the
+	 * check bytes. parity[0] holds its highest power.
+	 */
+	memset(parity, 0, nroots);
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t feedback = data[i] ^ parity[0];
+		memmove(parity, parity + 1, nroots - 1);
+		parity[nroots - 1] = 0;
+		if (feedback)
+		{
+			uint8_t f = pgm_read8(&gf_log[feedback]);
+			for (uint8_t j = 0; j < nroots; j++)
+			{
+				uint8_t g = gen[nroots - 1 - j];
+				if (g)
+					parity[j] ^= gf_pow(f + pgm_read8(&gf_log[g]));
+			}
+		}
+	}
+}
+
+int rs_decode(uint8_t *block, size_t len, uint8_t nroots)
+{
+	uint8_t synd[RS_MAX_ROOTS];
+	uint8_t lambda[RS_MAX_ROOTS + 1];
+	uint8_t prev[RS_MAX_ROOTS + 1];
+	uint8_t tmp[RS_MAX_ROOTS + 1];
+	uint8_t omega[RS_MAX_ROOTS];
+	uint8_t loc[RS_MAX_ROOTS / 2];
+	bool errors = false;
+
+	ASSERT(nroots <= RS_MAX_ROOTS);
+	ASSERT(len <= RS_MAX_LEN && len > nroots);
+
+	/*
+	 * Syndromes: the codeword evaluated at each root of the generator.
+	 * block[0] is the coefficient of the highest power.
+	 */
+	for (uint8_t j = 0; j < nroots; j++)
+	{
+		uint8_t root = gf_pow(j + 1);
+		uint8_t s = 0;
+		for (size_t i = 0; i < len; i++)
+			s = gf_mul(s, root) ^ block[i];
+		synd[j] = s;
+		if (s)
+			errors = true;
+	}
+	if (!errors)
+		return 0;
+
+	/* Berlekamp-Massey, for the error locator polynomial lambda */
+	memset(lambda, 0, nroots + 1);
+	memset(prev, 0, nroots + 1);
+	lambda[0] = prev[0] = 1;
+	uint8_t order = 0, shift = 1, last = 1;
+
+	for (uint8_t r = 0; r < nroots; r++)
+	{
+		uint8_t d = synd[r];
+		for (uint8_t i = 1; i <= order; i++)
+			d ^= gf_mul(lambda[i], synd[r - i]);
+
+		if (!d)
+		{
+			shift++;
+			continue;
+		}
+
+		uint8_t scale = gf_div(d, last);
+		memcpy(tmp, lambda, nroots + 1);
+		for (uint8_t i = shift; i <= nroots; i++)
+			lambda[i] ^= gf_mul(scale, prev[i - shift]);
+
+		if (2 * order <= r)
+		{
+			order = r + 1 - order;
+			memcpy(prev, tmp, nroots + 1);
+			last = d;
+			shift = 1;
+		}
+		else
+		{
+			shift++;
+		}
+	}
+
+	if (order > nroots / 2)
+		return -1;
+
+	/*
+	 * Chien search: byte i has error locator a^(len - 1 - i), and is
+	 * wrong if lambda has a root at its inverse.
+	 */
+	uint8_t found = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		uint16_t inv = 255 - (len - 1 - i);
+		uint8_t sum = lambda[0];
+		for (uint8_t j = 1; j <= order; j++)
+			if (lambda[j])
+				sum ^= gf_pow(gf_log_of(lambda[j]) + inv * j);
+		if (!sum)
+		{
+			if (found == order)
+				return -1;
+			loc[found++] = i;
+		}
+	}
+	if (found != order)
+		return -1;
+
+	/* Error evaluator: omega = synd * lambda mod x^nroots */
+	for (uint8_t i = 0; i < nroots; i++)
+	{
+		uint8_t o = 0;
+		for (uint8_t j = 0; j <= i && j <= order; j++)
+			o ^= gf_mul(lambda[j], synd[i - j]);
+		omega[i] = o;
+	}
+
+	/*
+	 * Forney: with the first root at a^1, the error value is
+	 * omega(X^-1) / lambda'(X^-1), X being the error locator.
+	 * Check them all before touching the block.
+	 */
+	uint8_t value[RS_MAX_ROOTS / 2];
+	for (uint8_t k = 0; k < found; k++)
+	{
+		uint16_t inv = 255 - (len - 1 - loc[k]);
+		uint8_t num = 0, den = 0;
+
+		for (uint8_t i = 0; i < nroots; i++)
+			if (omega[i])
+				num ^= gf_pow(gf_log_of(omega[i]) + inv * i);
+
+		/* The derivative only keeps the odd powers */
+		for (uint8_t i = 1; i <= order; i += 2)
+			if (lambda[i])
+				den ^= gf_pow(gf_log_of(lambda[i]) + inv * (i - 1));
+
+		if (!den)
+			return -1;
+		value[k] = gf_div(num, den);
+	}
+
+	for (uint8_t k = 0; k < found; k++)
+		block[loc[k]] ^= value[k];
+
+	return found;
+}
@@ -0,0 +1,86 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2009 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Reed-Solomon codes over GF(2^8).
+ *
+ * These are the codes used by FX.25: field generator polynomial 0x11d,
+ * first consecutive root 1 and primitive element 1. Codewords are at
+ * most 255 bytes long, data first and check bytes last; shorter ones
+ * are handled as the full length code with leading zeros.
+ *
+ * The field tables take 511 bytes of program memory, and everything
+ * else is worked out as needed.
+ *
+ * $WIZ$ module_name = "rs"
+ */
+
+#ifndef ALGO_RS_H
+#define ALGO_RS_H
+
+#include <cfg/compiler.h>
+
+EXTERN_C_BEGIN
+
+/** Longest codeword, check bytes included. */
+#define RS_MAX_LEN 255
+
+/** Most check bytes a codeword can have. */
+#define RS_MAX_ROOTS 64
+
+/**
+ * Compute the check bytes for a block of data.
+ *
+ * \param data    The data to protect.
+ * \param len     Length of the data. Together with the check bytes it
+ *                must fit in RS_MAX_LEN.
+ * \param parity  Where to put the check bytes.
+ * \param nroots  How many check bytes to compute, at most RS_MAX_ROOTS.
+ */
+void rs_encode(const uint8_t *data, size_t len, uint8_t *parity, uint8_t nroots);
+
+/**
+ * Correct the errors in a codeword, in place.
+ *
+ * Up to nroots / 2 wrong bytes can be corrected.
+ *
+ * \param block   The codeword, data followed by check bytes.
+ * \param len     Length of the codeword, check bytes included.
+ * \param nroots  How many check bytes the codeword has.
+ *
+ * \return The number of bytes corrected, or -1 if there were too many
+ *         errors, in which case the codeword is left as it was.
+ */
+int rs_decode(uint8_t *block, size_t len, uint8_t nroots);
+
+EXTERN_C_END
+
+#endif /* ALGO_RS_H */
@@ -38,6 +38,8 @@
 #ifndef CFG_AX25_H
 #define CFG_AX25_H
 
+#include <cpu/detect.h>
+
 /**
  * Module logging level.
  *
@@ -72,4 +74,51 @@
  */
 #define CONFIG_AX25_RPT_LST 1
 
+/**
+ * Try to recover received frames that fail the CRC check.
+ * 0 disables it, 1 corrects one wrong bit, 2 also corrects two
+ * adjacent wrong bits, which is what a single wrong bit on the
+ * air turns into after NRZI decoding.
+ * On the AVR the search is a loop over the frame's bits, on
+ * bigger CPUs a 128KB lookup table is used instead.
+ *
+ * Beware that a frame mangled beyond repair can now pass the
+ * check: if its address field still looks right, the chance
+ * goes from 1 in 65536 to a few percent.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ * $WIZ$ max = 2
+ */
+#ifndef CONFIG_AX25_FIX_BITS
+	#define CONFIG_AX25_FIX_BITS 0
+#endif
+
+/**
+ * Support FX.25, AX25 frames wrapped in a Reed-Solomon code.
+ * Frames are only sent that way if AX25Ctx.fx25 is set, but
+ * the modem looks for FX.25 frames all the time, which takes
+ * a 255 byte buffer and some time on every received bit.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#ifndef CONFIG_AX25_FX25
+	#if CPU_AVR
+		#define CONFIG_AX25_FX25 0
+	#else
+		#define CONFIG_AX25_FX25 1
+	#endif
+#endif
+
+/**
+ * Count received frames, and frames that fail the CRC check,
+ * in AX25Ctx.frames and AX25Ctx.crc_errors, for keeping an eye
+ * on how well a station is being received.
+ *
+ * $WIZ$ type = "boolean"
+ */
+#ifndef CONFIG_AX25_STATS
+	#define CONFIG_AX25_STATS 1
+#endif
+
 #endif /* CFG_AX25_H */
@@ -0,0 +1,64 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2008 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Configuration file for the CRC-CCITT module.
+ */
+
+#ifndef CFG_CRC_CCITT_H
+#define CFG_CRC_CCITT_H
+
+#include <cpu/detect.h>
+
+/**
+ * How many bytes crc_ccitt() handles per round of table lookups.
+ *
+ * 0 uses a 16 entry table and looks up each byte a nibble at a
+ * time, which keeps the table in 32 bytes of flash. 1 uses the
+ * classic 256 entry table. 4 and 8 add 3 or 7 more tables (512
+ * bytes each) so that crc_ccitt() can work on 4 or 8 bytes at a
+ * time, which is much faster on big CPUs. updcrc_ccitt() always
+ * works a byte at a time, with the nibble table if 0 is selected
+ * and the 256 entry table otherwise.
+ *
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 0
+ * $WIZ$ max = 8
+ */
+#ifndef CONFIG_CRC_CCITT_SLICE
+	#if CPU_AVR
+		#define CONFIG_CRC_CCITT_SLICE 0
+	#else
+		#define CONFIG_CRC_CCITT_SLICE 8
+	#endif
+#endif
+
+#endif /* CFG_CRC_CCITT_H */
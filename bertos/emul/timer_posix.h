@@ -0,0 +1,68 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2005, 2008 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Low-level timer support for hosted (POSIX) environments.
+ *
+ * \author Bernie Innocenti <bernie@codewiz.org>
+ */
+
+#ifndef EMUL_TIMER_POSIX_H
+#define EMUL_TIMER_POSIX_H
+
+#include <cfg/compiler.h>
+
+// HW dependent timer initialization
+#define DEFINE_TIMER_ISR     void timer_isr(UNUSED_ARG(int, arg))
+
+/** Most Linux kernels can't do better than this (CONFIG_HZ=250). */
+#define TIMER_TICKS_PER_SEC  250
+
+/** High-precision timer counter frequency */
+#define TIMER_HW_HPTICKS_PER_SEC  1000000
+
+/// Type of time expressed in ticks of the hardware high-precision timer
+typedef unsigned int hptime_t;
+#define SIZEOF_HPTIME_T 4
+
+INLINE hptime_t timer_hw_hpread(void)
+{
+	// TODO
+	return 0;
+}
+
+/** Not needed, timer IRQ handler called only for timer source */
+#define timer_hw_triggered() (true)
+
+void timer_hw_init(void);
+void timer_hw_cleanup(void);
+
+#endif /* EMUL_TIMER_POSIX_H */
@@ -42,6 +42,9 @@
 #include "cfg/cfg_ax25.h"
 
 #include <algo/crc_ccitt.h>
+#if CONFIG_AX25_FX25
+	#include "fx25.h"
+#endif
 
 #define LOG_LEVEL  AX25_LOG_LEVEL
 #define LOG_FORMAT AX25_LOG_FORMAT
@@ -61,6 +64,15 @@
 		} while(0) 
 #endif
 
+/* Counters stop at their maximum instead of wrapping around */
+#define AX25_INC(counter) do { if ((counter) < UINT16_MAX) (counter)++; } while (0)
+
+#if CONFIG_AX25_STATS
+	#define AX25_COUNT(counter) AX25_INC(counter)
+#else
+	#define AX25_COUNT(counter) do { } while (0)
+#endif
+
 #define DECODE_CALL(buf, addr) \
 	for (unsigned i = 0; i < sizeof((addr)); i++) \
 	{ \
@@ -68,10 +80,14 @@
 		(addr)[i] = (c == ' ') ? '\x0' : c; \
 	}
 
-static void ax25_decode(AX25Ctx *ctx)
+static void ax25_decode(AX25Ctx *ctx, const uint8_t *frame, size_t frm_len)
 {
 	AX25Msg msg;
-	uint8_t *buf = ctx->buf;
+	const uint8_t *buf = frame;
+
+	/* Hand out the whole frame, whatever it contains, minus the CRC */
+	if (ctx->frame_hook)
+		ctx->frame_hook(frame, frm_len - 2);
 
 	DECODE_CALL(buf, msg.dst.call);
 	msg.dst.ssid = (*buf++ >> 1) & 0x0F;
@@ -110,7 +126,7 @@ static void ax25_decode(AX25Ctx *ctx)
 		return;
 	}
 
-	msg.len = ctx->frm_len - 2 - (buf - ctx->buf);
+	msg.len = frm_len - 2 - (buf - frame);
 	msg.info = buf;
 
 	if (ctx->hook)
@@ -136,15 +152,16 @@ void ax25_poll(AX25Ctx *ctx)
 	{
 		if (!ctx->escape && c == HDLC_FLAG)
 		{
-			if (ctx->frm_len >= AX25_MIN_FRAME_LEN)
-			{
-				if (ctx->crc_in == AX25_CRC_CORRECT)
-				{
-					ax25_decode(ctx);
-				}
-			}
+			/*
+			 * The CRC is only checked here, over the whole frame at
+			 * once, so the bytes of frames that turn out to be too
+			 * short or get aborted (mostly noise) cost nothing more
+			 * than being stored. Aborted and overlong frames are not
+			 * checked at all.
+			 */
+			if (ctx->sync)
+				ax25_receive(ctx, ctx->buf, ctx->frm_len);
 			ctx->sync = true;
-			ctx->crc_in = CRC_CCITT_INIT_VAL;
 			ctx->frm_len = 0;
 			continue;
 		}
@@ -152,6 +169,7 @@ void ax25_poll(AX25Ctx *ctx)
 		if (!ctx->escape && c == HDLC_RESET)
 		{
 			ctx->sync = false;
+			ctx->frm_len = 0;
 			continue;
 		}
 
@@ -166,11 +184,11 @@ void ax25_poll(AX25Ctx *ctx)
 			if (ctx->frm_len < CONFIG_AX25_FRAME_BUF_LEN)
 			{
 				ctx->buf[ctx->frm_len++] = c;
-				ctx->crc_in = updcrc_ccitt(c, ctx->crc_in);
 			}
 			else
 			{
 				ctx->sync = false;
+				ctx->frm_len = 0;
 			}
 		}
 		ctx->escape = false;
@@ -182,15 +200,364 @@ void ax25_poll(AX25Ctx *ctx)
 	}
 }
 
+#if CONFIG_AX25_FIX_BITS
+/*
+ * Bit error correction.
+ *
+ * The CRC is linear, so flipping one bit of a frame changes the CRC
+ * computed over it by a value (the syndrome) which only depends on
+ * how many bits follow the flipped one. If a frame fails the CRC
+ * check, the difference between the CRC we got and the correct one
+ * tells us which bit to flip back, if a single bit is wrong.
+ *
+ * The syndrome of the last bit of the frame is one CRC step applied
+ * to FIX_SINGLE, and each bit before it adds one more step. Two
+ * adjacent bits give the same sequence, starting from FIX_DOUBLE.
+ */
+#define FIX_SINGLE 0x0001
+#define FIX_DOUBLE 0x8409
+
+#define FIX_MAX_BITS (CONFIG_AX25_FRAME_BUF_LEN * 8)
+
+/* Look the syndrome up in a table, or search for it */
+#ifndef AX25_FIX_TABLE
+	#define AX25_FIX_TABLE OS_HOSTED
+#endif
+
+INLINE uint16_t fix_step(uint16_t r)
+{
+	return (r & 1) ? (r >> 1) ^ 0x8408 : r >> 1;
+}
+
+#if AX25_FIX_TABLE
+/*
+ * For each syndrome, the position of the wrong bit counted from the
+ * end of the frame, times two, plus one if two adjacent bits are
+ * wrong. Zero if no correctable error has that syndrome.
+ *
+ * The table takes 128 KB, more than the whole RAM of the small
+ * targets this code runs on, so it is only used on a hosted build.
+ * There it saves stepping the CRC through every bit position of each
+ * broken frame, which matters when decoding recordings with many of
+ * them. Embedded targets search for the syndrome instead.
+ */
+static uint16_t fix_tab[0x10000];
+static bool fix_tab_ready;
+
+static void fix_init(void)
+{
+	uint16_t r = FIX_SINGLE;
+	for (uint16_t pos = 0; pos < FIX_MAX_BITS; pos++)
+	{
+		r = fix_step(r);
+		fix_tab[r] = ((pos << 1) | 0) + 1;
+	}
+
+	#if CONFIG_AX25_FIX_BITS > 1
+	r = FIX_DOUBLE;
+	for (uint16_t pos = 0; pos < FIX_MAX_BITS - 1; pos++)
+	{
+		r = fix_step(r);
+		/* No overlaps within a frame's length, but keep singles first */
+		if (!fix_tab[r])
+			fix_tab[r] = ((pos << 1) | 1) + 1;
+	}
+	#endif
+
+	fix_tab_ready = true;
+}
+
+static int fix_find(uint16_t syndrome, size_t bits)
+{
+	if (!fix_tab_ready)
+		fix_init();
+
+	int found = (int)fix_tab[syndrome] - 1;
+	if (found < 0 || (size_t)(found >> 1) + (found & 1) >= bits)
+		return -1;
+	return found;
+}
+#else
+/*
+ * Walk the syndrome back through the CRC one bit at a time until we
+ * reach one of the starting values. The number of steps back is the
+ * position of the wrong bit. This costs a few cycles per bit of the
+ * frame, and needs no memory.
+ */
+static int fix_find(uint16_t syndrome, size_t bits)
+{
+	for (size_t pos = 0; pos < bits; pos++)
+	{
+		if (syndrome & 0x8000)
+			syndrome = ((syndrome ^ 0x8408) << 1) | 1;
+		else
+			syndrome <<= 1;
+
+		if (syndrome == FIX_SINGLE)
+			return pos << 1;
+		#if CONFIG_AX25_FIX_BITS > 1
+		if (syndrome == FIX_DOUBLE && pos + 1 < bits)
+			return (pos << 1) | 1;
+		#endif
+	}
+	return -1;
+}
+#endif
+
+INLINE void fix_flip(uint8_t *frame, size_t bits, size_t pos)
+{
+	/* Bits go out least significant first */
+	size_t bit = bits - 1 - pos;
+	frame[bit >> 3] ^= BV(bit & 7);
+}
+
+static bool fix_callChar(uint8_t c)
+{
+	c >>= 1;
+	return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == ' ';
+}
+
+/*
+ * Random data has a fair chance to look like a frame with one or two
+ * wrong bits, so a corrected frame is only accepted if it also has a
+ * sensible address field: callsigns made of letters, digits and
+ * spaces, and at least a destination and a source.
+ */
+static bool fix_plausible(const uint8_t *frame, size_t len)
+{
+	for (size_t i = 0; i < len - 2; i++)
+	{
+		if (i % 7 == 6)
+		{
+			if (frame[i] & 0x01)
+				return i >= 13;
+		}
+		else if (!fix_callChar(frame[i]))
+		{
+			return false;
+		}
+	}
+	return false;
+}
+
+/*
+ * Try to fix a frame which has failed the CRC check with the given
+ * syndrome. The frame is left as it was if it can't be fixed.
+ */
+static bool ax25_fix(uint8_t *frame, size_t len, uint16_t syndrome)
+{
+	size_t bits = len * 8;
+	int found = fix_find(syndrome, bits);
+	if (found < 0)
+		return false;
+
+	size_t pos = found >> 1;
+	bool two = found & 1;
+
+	fix_flip(frame, bits, pos);
+	if (two)
+		fix_flip(frame, bits, pos + 1);
+
+	if (crc_ccitt(CRC_CCITT_INIT_VAL, frame, len) == AX25_CRC_CORRECT
+		&& fix_plausible(frame, len))
+		return true;
+
+	fix_flip(frame, bits, pos);
+	if (two)
+		fix_flip(frame, bits, pos + 1);
+	return false;
+}
+
+/*
+ * A tone the receiver got wrong makes two data bits wrong, because of
+ * the NRZI coding: the bit it stands for, and the one after it. Here
+ * bits are counted from the start of the frame.
+ */
+INLINE void fix_flipTone(uint8_t *frame, size_t bits, uint16_t pos)
+{
+	frame[pos >> 3] ^= BV(pos & 7);
+	if ((size_t)pos + 1 < bits)
+		frame[(pos + 1) >> 3] ^= BV((pos + 1) & 7);
+}
+
+INLINE bool fix_good(const uint8_t *frame, size_t len)
+{
+	return crc_ccitt(CRC_CCITT_INIT_VAL, frame, len) == AX25_CRC_CORRECT
+		&& fix_plausible(frame, len);
+}
+
+/*
+ * Try to fix a frame using the bits the receiver was least sure of,
+ * each on its own and then in pairs, least sure first. This can fix
+ * two wrong tones, where ax25_fix() can fix at most one.
+ */
+static bool ax25_fixSoft(uint8_t *frame, size_t len, const uint16_t *weak, uint8_t weak_cnt)
+{
+	size_t bits = len * 8;
+
+	for (uint8_t i = 0; i < weak_cnt; i++)
+	{
+		if (weak[i] >= bits)
+			continue;
+
+		fix_flipTone(frame, bits, weak[i]);
+		if (fix_good(frame, len))
+			return true;
+
+		for (uint8_t j = 0; j < i; j++)
+		{
+			if (weak[j] >= bits)
+				continue;
+
+			fix_flipTone(frame, bits, weak[j]);
+			if (fix_good(frame, len))
+				return true;
+			fix_flipTone(frame, bits, weak[j]);
+		}
+		fix_flipTone(frame, bits, weak[i]);
+	}
+	return false;
+}
+#endif /* CONFIG_AX25_FIX_BITS */
+
+/**
+ * Process a complete AX25 frame received out of band.
+ * This is an alternative to ax25_poll() for channels that deliver whole
+ * frames, already stripped of HDLC flags and without any escaping, instead
+ * of a stream of characters. The frame is checked and decoded where it is,
+ * and the linked callback executed if it is a valid message.
+ * If CONFIG_AX25_FIX_BITS is enabled, frames with a bad CRC may be
+ * corrected in place.
+ *
+ * \param ctx AX25 context to operate on.
+ * \param frame the received frame, including the CRC.
+ * \param len length of the frame.
+ */
+void ax25_receive(AX25Ctx *ctx, uint8_t *frame, size_t len)
+{
+	ax25_receiveSoft(ctx, frame, len, NULL, 0);
+}
+
+/**
+ * Process a complete AX25 frame received out of band, along with the
+ * bits of it the receiver was least sure of.
+ * This works like ax25_receive(), but if the CRC check fails and
+ * CONFIG_AX25_FIX_BITS is enabled, flipping the doubtful bits is tried
+ * before searching the whole frame for bit errors.
+ *
+ * \param ctx AX25 context to operate on.
+ * \param frame the received frame, including the CRC.
+ * \param len length of the frame.
+ * \param weak positions of the doubtful bits, least sure first. Bits are
+ *             counted from the start of the frame, least significant bit
+ *             of each byte first. Each stands for a received tone, so the
+ *             bit after it is flipped along with it.
+ * \param weak_cnt number of positions in \a weak.
+ */
+void ax25_receiveSoft(AX25Ctx *ctx, uint8_t *frame, size_t len, const uint16_t *weak, uint8_t weak_cnt)
+{
+	if (len < AX25_MIN_FRAME_LEN)
+		return;
+
+	uint16_t crc = crc_ccitt(CRC_CCITT_INIT_VAL, frame, len);
+	if (crc == AX25_CRC_CORRECT)
+	{
+		AX25_COUNT(ctx->frames);
+		ax25_decode(ctx, frame, len);
+	}
+	#if CONFIG_AX25_FIX_BITS
+	else if (ax25_fixSoft(frame, len, weak, weak_cnt)
+		|| ax25_fix(frame, len, crc ^ AX25_CRC_CORRECT))
+	{
+		AX25_INC(ctx->fixed);
+		AX25_COUNT(ctx->frames);
+		ax25_decode(ctx, frame, len);
+	}
+	#endif
+	else
+	{
+		AX25_COUNT(ctx->crc_errors);
+	}
+
+	#if !CONFIG_AX25_FIX_BITS
+	(void)weak;
+	(void)weak_cnt;
+	#endif
+}
+
+#if CONFIG_AX25_FX25
+/*
+ * Frames sent with FX.25 are collected here, since the whole frame is
+ * needed to pick the code and compute the check bytes.
+ */
+static uint8_t fx25_frame[CONFIG_AX25_FRAME_BUF_LEN];
+static uint8_t fx25_block[FX25_TAG_LEN + 255];
+#endif
+
 static void ax25_putchar(AX25Ctx *ctx, uint8_t c)
 {
+	ctx->crc_out = updcrc_ccitt(c, ctx->crc_out);
+
+	#if CONFIG_AX25_FX25
+	if (ctx->fx25_tx)
+	{
+		/* Too long for FX.25, and for receivers with our buffer size */
+		if (ctx->fx25_len < sizeof(fx25_frame))
+			fx25_frame[ctx->fx25_len] = c;
+		ctx->fx25_len++;
+		return;
+	}
+	#endif
+
 	if (c == HDLC_FLAG || c == HDLC_RESET
-		|| c == AX25_ESC)
+		|| c == AX25_ESC || c == AX25_RAW)
 		kfile_putc(AX25_ESC, ctx->ch);
-	ctx->crc_out = updcrc_ccitt(c, ctx->crc_out);
 	kfile_putc(c, ctx->ch);
 }
 
+#if CONFIG_AX25_FX25
+/*
+ * Send the collected frame, with its CRC. The correlation tag and the
+ * codeword are sent without bit stuffing, so each byte is preceded by
+ * AX25_RAW. If the frame doesn't fit in any FX.25 code, it is sent as
+ * plain AX25. A frame too long for the collection buffer has lost its
+ * end, so it is not sent at all, and counted in AX25Ctx.fx25_dropped.
+ */
+static void ax25_sendFx25(AX25Ctx *ctx)
+{
+	ctx->fx25_tx = false;
+
+	if (ctx->fx25_len > sizeof(fx25_frame))
+	{
+		AX25_INC(ctx->fx25_dropped);
+		return;
+	}
+
+	int mode = fx25_encode(fx25_frame, ctx->fx25_len, ctx->fx25, fx25_block + FX25_TAG_LEN);
+
+	if (mode < 0)
+	{
+		kfile_putc(HDLC_FLAG, ctx->ch);
+		for (size_t i = 0; i < ctx->fx25_len; i++)
+			ax25_putchar(ctx, fx25_frame[i]);
+		kfile_putc(HDLC_FLAG, ctx->ch);
+		return;
+	}
+
+	uint64_t tag = fx25_tag(mode);
+	for (uint8_t i = 0; i < FX25_TAG_LEN; i++)
+		fx25_block[i] = tag >> (i * 8);
+
+	size_t len = FX25_TAG_LEN + fx25_blockLen(mode);
+	for (size_t i = 0; i < len; i++)
+	{
+		kfile_putc(AX25_RAW, ctx->ch);
+		kfile_putc(fx25_block[i], ctx->ch);
+	}
+	kfile_putc(HDLC_FLAG, ctx->ch);
+}
+#endif
+
 static void ax25_sendCall(AX25Ctx *ctx, const AX25Call *addr, bool last)
 {
 	unsigned len = MIN(sizeof(addr->call), strlen(addr->call));
@@ -230,9 +597,7 @@ void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const voi
 	ASSERT(path);
 	ASSERT(path_len >= 2);
 
-	ctx->crc_out = CRC_CCITT_INIT_VAL;
-	kfile_putc(HDLC_FLAG, ctx->ch);
-
+	ax25_sendStart(ctx);
 
 	/* Send call */
 	for (size_t i = 0; i < path_len; i++)
@@ -244,6 +609,52 @@ void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const voi
 	while (len--)
 		ax25_putchar(ctx, *buf++);
 
+	ax25_sendEnd(ctx);
+}
+
+/**
+ * Start sending an AX25 frame on the channel, a byte at a time.
+ * The frame is then sent with ax25_sendByte() and finished with
+ * ax25_sendEnd(), which is useful when it is not all available at once.
+ * If the frame is to be sent with FX.25 (see AX25Ctx.fx25), nothing goes
+ * out until ax25_sendEnd(), and a frame longer than CONFIG_AX25_FRAME_BUF_LEN
+ * is dropped.
+ * \param ctx AX25 context to operate on.
+ */
+void ax25_sendStart(AX25Ctx *ctx)
+{
+	ctx->crc_out = CRC_CCITT_INIT_VAL;
+
+	#if CONFIG_AX25_FX25
+	if (ctx->fx25)
+	{
+		ctx->fx25_tx = true;
+		ctx->fx25_len = 0;
+		return;
+	}
+	#endif
+
+	kfile_putc(HDLC_FLAG, ctx->ch);
+}
+
+/**
+ * Send the next byte of a frame started with ax25_sendStart().
+ * The byte is sent as is, so the addresses, control and PID fields are
+ * up to the caller.
+ * \param ctx AX25 context to operate on.
+ * \param c byte to send.
+ */
+void ax25_sendByte(AX25Ctx *ctx, uint8_t c)
+{
+	ax25_putchar(ctx, c);
+}
+
+/**
+ * Finish a frame started with ax25_sendStart(), sending its CRC.
+ * \param ctx AX25 context to operate on.
+ */
+void ax25_sendEnd(AX25Ctx *ctx)
+{
 	/*
 	 * According to AX25 protocol,
 	 * CRC is sent in reverse order!
@@ -255,9 +666,35 @@ void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const voi
 
 	ASSERT(ctx->crc_out == AX25_CRC_CORRECT);
 
+	#if CONFIG_AX25_FX25
+	if (ctx->fx25_tx)
+	{
+		ax25_sendFx25(ctx);
+		return;
+	}
+	#endif
+
 	kfile_putc(HDLC_FLAG, ctx->ch);
 }
 
+/**
+ * Send a raw AX25 frame on the channel.
+ * The frame must already contain the addresses, control and PID fields;
+ * only the HDLC flags and the CRC are added.
+ * \param ctx AX25 context to operate on.
+ * \param _buf frame buffer.
+ * \param len length of the frame.
+ */
+void ax25_sendRaw(AX25Ctx *ctx, const void *_buf, size_t len)
+{
+	const uint8_t *buf = (const uint8_t *)_buf;
+
+	ax25_sendStart(ctx);
+	while (len--)
+		ax25_putchar(ctx, *buf++);
+	ax25_sendEnd(ctx);
+}
+
 /**
  * Init the AX25 protocol decoder.
  *
@@ -273,5 +710,5 @@ void ax25_init(AX25Ctx *ctx, KFile *channel, ax25_callback_t hook)
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->ch = channel;
 	ctx->hook = hook;
-	ctx->crc_in = ctx->crc_out = CRC_CCITT_INIT_VAL;
+	ctx->crc_out = CRC_CCITT_INIT_VAL;
 }
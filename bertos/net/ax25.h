@@ -68,6 +68,11 @@ struct AX25Msg; // fwd declaration
  */
 typedef void (*ax25_callback_t)(struct AX25Msg *msg);
 
+/**
+ * Type for AX25 raw frames callback.
+ */
+typedef void (*ax25_frame_callback_t)(const uint8_t *frame, size_t len);
+
 
 /**
  * AX25 Protocol context.
@@ -77,11 +82,24 @@ typedef struct AX25Ctx
 	uint8_t buf[CONFIG_AX25_FRAME_BUF_LEN]; ///< buffer for received chars
 	KFile *ch;        ///< KFile used to access the physical medium
 	size_t frm_len;   ///< received frame length.
-	uint16_t crc_in;  ///< CRC for current received frame
 	uint16_t crc_out; ///< CRC of current sent frame
 	ax25_callback_t hook; ///< Hook function to be called when a message is received
+	ax25_frame_callback_t frame_hook; ///< Hook function to be called with every raw frame received, may be NULL
 	bool sync;   ///< True if we have received a HDLC flag.
 	bool escape; ///< True when we have to escape the following char.
+	#if CONFIG_AX25_FIX_BITS
+	uint16_t fixed; ///< Number of frames recovered by flipping wrong bits
+	#endif
+	#if CONFIG_AX25_STATS
+	uint16_t frames;     ///< Number of good frames received, including fixed ones
+	uint16_t crc_errors; ///< Number of frames dropped because of a bad CRC
+	#endif
+	#if CONFIG_AX25_FX25
+	uint8_t fx25;   ///< FX.25 check bytes to send frames with (16, 32 or 64), 0 to send plain AX25
+	bool fx25_tx;   ///< True while the frame being sent is collected for FX.25
+	size_t fx25_len; ///< Length of the frame collected so far
+	uint16_t fx25_dropped; ///< Number of frames not sent because they were too long to collect
+	#endif
 } AX25Ctx;
 
 
@@ -145,6 +163,7 @@ typedef struct AX25Msg
 #define HDLC_FLAG  0x7E
 #define HDLC_RESET 0x7F
 #define AX25_ESC   0x1B
+#define AX25_RAW   0x1C ///< The next byte is sent as is, without bit stuffing (for FX.25)
 /* \} */
 
 
@@ -169,7 +188,13 @@ typedef struct AX25Msg
 #define AX25_PATH(dst, src, ...) { dst, src, ## __VA_ARGS__ }
 
 void ax25_poll(AX25Ctx *ctx);
+void ax25_receive(AX25Ctx *ctx, uint8_t *frame, size_t len);
+void ax25_receiveSoft(AX25Ctx *ctx, uint8_t *frame, size_t len, const uint16_t *weak, uint8_t weak_cnt);
 void ax25_sendVia(AX25Ctx *ctx, const AX25Call *path, size_t path_len, const void *_buf, size_t len);
+void ax25_sendRaw(AX25Ctx *ctx, const void *_buf, size_t len);
+void ax25_sendStart(AX25Ctx *ctx);
+void ax25_sendByte(AX25Ctx *ctx, uint8_t c);
+void ax25_sendEnd(AX25Ctx *ctx);
 
 /**
  * Send an AX25 frame on the channel.
@@ -0,0 +1,268 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2009 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief FX.25: Reed-Solomon forward error correction for AX25 frames (implementation).
+ */
+
+#include "fx25.h"
+
+#include "ax25.h"
+
+#include <algo/rs.h>
+#include <cfg/debug.h>
+#include <cpu/pgm.h>
+
+#include <string.h>
+
+#if CONFIG_AX25_FX25
+
+typedef struct Fx25Mode
+{
+	uint32_t tag_lo; ///< Correlation tag, low half
+	uint32_t tag_hi; ///< Correlation tag, high half
+	uint8_t n;       ///< Codeword length
+	uint8_t k;       ///< Data bytes in the codeword
+} Fx25Mode;
+
+#define FX25_MODE(tag, n, k) { (uint32_t)(tag), (uint32_t)((tag) >> 32), (n), (k) }
+
+/* The codes from the FX.25 specification, shortest first for each check length */
+static const Fx25Mode PROGMEM fx25_modes[FX25_MODES] =
+{
+	FX25_MODE(0x8F056EB4369660EEULL,  48,  32),
+	FX25_MODE(0xC7DC0508F3D9B09EULL,  80,  64),
+	FX25_MODE(0x26FF60A600CC8FDEULL, 144, 128),
+	FX25_MODE(0xB74DB7DF8A532F3EULL, 255, 239),
+	FX25_MODE(0xDBF869BD2DBB1776ULL,  64,  32),
+	FX25_MODE(0x1EB7B9CDBC09C00EULL,  96,  64),
+	FX25_MODE(0xFF94DC634F1CFF4EULL, 160, 128),
+	FX25_MODE(0x6E260B1AC5835FAEULL, 255, 223),
+	FX25_MODE(0x4A4ABEC4A724B796ULL, 128,  64),
+	FX25_MODE(0xAB69DB6A543188D6ULL, 192, 128),
+	FX25_MODE(0x3ADB0C13DEAE2836ULL, 255, 191),
+};
+
+uint64_t fx25_tag(int mode)
+{
+	ASSERT(mode >= 0 && mode < FX25_MODES);
+	return pgm_read32(&fx25_modes[mode].tag_lo)
+		| ((uint64_t)pgm_read32(&fx25_modes[mode].tag_hi) << 32);
+}
+
+uint8_t fx25_blockLen(int mode)
+{
+	ASSERT(mode >= 0 && mode < FX25_MODES);
+	return pgm_read8(&fx25_modes[mode].n);
+}
+
+uint8_t fx25_checkLen(int mode)
+{
+	ASSERT(mode >= 0 && mode < FX25_MODES);
+	return pgm_read8(&fx25_modes[mode].n) - pgm_read8(&fx25_modes[mode].k);
+}
+
+/*
+ * This runs for every bit received, so we stop counting the different
+ * bits as soon as there are too many of them.
+ */
+int fx25_tagFind(uint64_t bits)
+{
+	for (int mode = 0; mode < FX25_MODES; mode++)
+	{
+		uint64_t diff = bits ^ fx25_tag(mode);
+		uint8_t errors = 0;
+		while (diff && errors <= FX25_TAG_MAX_ERRORS)
+		{
+			diff &= diff - 1;
+			errors++;
+		}
+		if (errors <= FX25_TAG_MAX_ERRORS)
+			return mode;
+	}
+	return -1;
+}
+
+/*
+ * The frame goes in the codeword as a stream of bits, first bit in the
+ * least significant bit of the first byte.
+ */
+typedef struct Fx25Bits
+{
+	uint8_t *buf;
+	size_t pos;    ///< Bits written so far
+	uint8_t ones;  ///< Consecutive ones, for bit stuffing
+} Fx25Bits;
+
+static void fx25_putBit(Fx25Bits *out, bool bit)
+{
+	if (out->buf)
+	{
+		if (bit)
+			out->buf[out->pos >> 3] |= BV(out->pos & 7);
+		else
+			out->buf[out->pos >> 3] &= ~BV(out->pos & 7);
+	}
+	out->pos++;
+}
+
+static void fx25_putFlag(Fx25Bits *out)
+{
+	for (uint8_t i = 0; i < 8; i++)
+		fx25_putBit(out, (HDLC_FLAG >> i) & 1);
+	out->ones = 0;
+}
+
+static void fx25_putByte(Fx25Bits *out, uint8_t c)
+{
+	for (uint8_t i = 0; i < 8; i++)
+	{
+		bool bit = (c >> i) & 1;
+		fx25_putBit(out, bit);
+		if (bit && ++out->ones == 5)
+		{
+			fx25_putBit(out, 0);
+			out->ones = 0;
+		}
+		else if (!bit)
+		{
+			out->ones = 0;
+		}
+	}
+}
+
+/* Writes the frame between two flags, or just counts the bits if out->buf is NULL */
+static void fx25_putFrame(Fx25Bits *out, const uint8_t *frame, size_t len)
+{
+	fx25_putFlag(out);
+	for (size_t i = 0; i < len; i++)
+		fx25_putByte(out, frame[i]);
+	fx25_putFlag(out);
+}
+
+int fx25_encode(const uint8_t *frame, size_t len, uint8_t nroots, uint8_t *block)
+{
+	Fx25Bits out = { NULL, 0, 0 };
+	fx25_putFrame(&out, frame, len);
+	size_t needed = (out.pos + 7) / 8;
+
+	int mode;
+	for (mode = 0; mode < FX25_MODES; mode++)
+	{
+		uint8_t k = pgm_read8(&fx25_modes[mode].k);
+		if (fx25_checkLen(mode) == nroots && k >= needed)
+			break;
+	}
+	if (mode == FX25_MODES)
+		return -1;
+
+	uint8_t k = pgm_read8(&fx25_modes[mode].k);
+	out.buf = block;
+	out.pos = 0;
+	fx25_putFrame(&out, frame, len);
+
+	/* Fill up the rest of the data with more flags */
+	while (out.pos < (size_t)k * 8)
+	{
+		fx25_putBit(&out, (HDLC_FLAG >> (out.pos & 7)) & 1);
+	}
+
+	rs_encode(block, k, block + k, nroots);
+	return mode;
+}
+
+/*
+ * Takes the frame out of the data part of a codeword, the same way the
+ * modem's HDLC parser would: wait for a flag, drop the stuffed bits and
+ * stop at the next flag. Since the frame is shorter than the bits it is
+ * made from, it can be written over the data as we go.
+ */
+static size_t fx25_unstuff(uint8_t *data, size_t len)
+{
+	uint8_t bits = 0, current = 0, count = 0;
+	size_t out = 0;
+	bool receiving = false;
+
+	for (size_t pos = 0; pos < len * 8; pos++)
+	{
+		bits = (bits << 1) | ((data[pos >> 3] >> (pos & 7)) & 1);
+
+		if (bits == HDLC_FLAG)
+		{
+			if (receiving && out >= AX25_MIN_FRAME_LEN)
+				return out;
+			receiving = true;
+			out = 0;
+			count = 0;
+			continue;
+		}
+
+		if ((bits & HDLC_RESET) == HDLC_RESET)
+		{
+			receiving = false;
+			continue;
+		}
+
+		if (!receiving)
+			continue;
+
+		/* A zero after five ones was stuffed in */
+		if ((bits & 0x3f) == 0x3e)
+			continue;
+
+		current = (current >> 1) | ((bits & 1) << 7);
+		if (++count == 8)
+		{
+			data[out++] = current;
+			count = 0;
+		}
+	}
+
+	return 0;
+}
+
+size_t fx25_decode(uint8_t *block, int mode, int *corrected)
+{
+	uint8_t n = fx25_blockLen(mode);
+	uint8_t nroots = fx25_checkLen(mode);
+
+	int fixed = rs_decode(block, n, nroots);
+	if (corrected)
+		*corrected = fixed;
+
+	/*
+	 * Even if there were too many errors, the frame itself may have
+	 * come through fine, the CRC check will tell.
+	 */
+	return fx25_unstuff(block, n - nroots);
+}
+
+#endif /* CONFIG_AX25_FX25 */
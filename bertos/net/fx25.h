@@ -0,0 +1,120 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2009 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief FX.25: Reed-Solomon forward error correction for AX25 frames.
+ *
+ * An FX.25 transmission is an 8 byte correlation tag, which tells the
+ * receiver which Reed-Solomon code follows, and a codeword of that code.
+ * The data part of the codeword holds the AX25 frame exactly as it would
+ * be sent on its own, flags and bit stuffing included, padded with more
+ * flags. All of it is sent least significant bit first, without any bit
+ * stuffing of its own. Plain AX25 receivers still find the frame in
+ * there, and just see the rest as noise.
+ *
+ * $WIZ$ module_name = "fx25"
+ * $WIZ$ module_depends = "rs"
+ */
+
+#ifndef NET_FX25_H
+#define NET_FX25_H
+
+#include "cfg/cfg_ax25.h"
+
+#include <cfg/compiler.h>
+
+EXTERN_C_BEGIN
+
+/** Length of a correlation tag, in bytes. */
+#define FX25_TAG_LEN 8
+
+/**
+ * A received tag may have this many wrong bits and still be
+ * recognised. The tags are at least 32 bits apart from each other.
+ */
+#define FX25_TAG_MAX_ERRORS 8
+
+/** Number of known codes. */
+#define FX25_MODES 11
+
+/**
+ * Find which code a correlation tag stands for.
+ * \param bits the last 64 bits received, the first one in the least
+ *        significant bit.
+ * \return the index of the code, or -1 if \a bits is not a tag.
+ */
+int fx25_tagFind(uint64_t bits);
+
+/**
+ * \return the correlation tag of a code.
+ */
+uint64_t fx25_tag(int mode);
+
+/**
+ * \return the length of a codeword of a code, check bytes included.
+ */
+uint8_t fx25_blockLen(int mode);
+
+/**
+ * \return how many check bytes a code has.
+ */
+uint8_t fx25_checkLen(int mode);
+
+/**
+ * Pack an AX25 frame into an FX.25 codeword, picking the shortest code
+ * with \a nroots check bytes that it fits in.
+ *
+ * \param frame the frame, CRC included.
+ * \param len length of the frame.
+ * \param nroots check bytes wanted: 16, 32 or 64.
+ * \param block where to put the codeword, must have room for 255 bytes.
+ * \return the code used, or -1 if the frame doesn't fit in any of them.
+ */
+int fx25_encode(const uint8_t *frame, size_t len, uint8_t nroots, uint8_t *block);
+
+/**
+ * Correct a received FX.25 codeword, and take out the frame in it.
+ *
+ * The frame is put at the start of \a block, CRC included, but not
+ * checked, so it can be handed to ax25_receive().
+ *
+ * \param block the codeword.
+ * \param mode the code, as found by fx25_tagFind().
+ * \param corrected if not NULL, set to the number of bytes the
+ *        Reed-Solomon decoder has corrected, or -1 if there were too
+ *        many errors to correct.
+ * \return the length of the frame, or 0 if none was found.
+ */
+size_t fx25_decode(uint8_t *block, int mode, int *corrected);
+
+EXTERN_C_END
+
+#endif /* NET_FX25_H */